@@ -7,7 +7,16 @@ namespace AI {
 	static const Locale LOCALE("English", LC_NUMERIC);
 
 	Ubi::BigFile::File::SIZE findFileSize(Work::Edit &edit, const Ubi::BigFile::Path::VECTOR &pathVector) {
-		return Ubi::BigFile::findFile(edit.fileStream, pathVector)->size;
+		// the index is only used if it already exists, reading just these directories is faster than creating it
+		try {
+			Work::Index index(edit.fileStream, edit.getPath(), 0, false);
+			return index.findFile(edit.fileStream, pathVector).size;
+		} catch (std::system_error) {
+			// fall through
+		} catch (std::invalid_argument) {
+			// fall through
+		}
+		return Ubi::BigFile::findFile(edit.fileStream, pathVector).size;
 	}
 
 	void editF32(
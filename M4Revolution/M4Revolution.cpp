@@ -17,7 +17,11 @@
 
 void M4Revolution::destroy() {
 	#ifdef MULTITHREADED
+	#ifdef WINDOWS
 	CloseThreadpool(pool);
+	#else
+	poolOptional = std::nullopt;
+	#endif
 	#endif
 
 	// delete the temporary file when done
@@ -139,8 +143,14 @@ const nvtt::CompressionOptions &M4Revolution::CompressionOptions::get(const Ubi:
 	return hasAlpha ? dxt5 : dxt1;
 }
 
-M4Revolution::OutputHandler::OutputHandler(Work::FileTask &fileTask)
-	: fileTask(fileTask) {
+// DXT1 and DXT5 are made of fixed size blocks, so their size is known exactly before compressing
+bool M4Revolution::CompressionOptions::isBlockCompressed(const nvtt::CompressionOptions &compressionOptions) const {
+	return &compressionOptions == &dxt1 || &compressionOptions == &dxt5;
+}
+
+M4Revolution::OutputHandler::OutputHandler(Work::FileTask &fileTask, Work::Gate &memoryGate)
+	: fileTask(fileTask),
+	memoryGate(memoryGate) {
 }
 
 void M4Revolution::OutputHandler::beginImage(int size, int width, int height, int depth, int face, int miplevel) {
@@ -156,17 +166,40 @@ bool M4Revolution::OutputHandler::writeData(const void* data, int size) {
 		return false;
 	}
 
+	const size_t SLAB_SIZE = Work::Data::SLAB_SIZE;
+
+	const unsigned char* pointer = (const unsigned char*)data;
+	size_t remainingSize = size;
+	size_t copySize = 0;
+
 	try {
-		Work::Data::POINTER pointer(new unsigned char[size]);
+		while (remainingSize) {
+			if (!slabPointer) {
+				slabPointer = Work::Data::allocateSlab();
+			}
+
+			copySize = __min(remainingSize, SLAB_SIZE - slabSize);
+
+			if (memcpy_s(slabPointer.get() + slabSize, SLAB_SIZE - slabSize, pointer, copySize)) {
+				return false;
+			}
+
+			slabSize += copySize;
+			pointer += copySize;
+			remainingSize -= copySize;
+
+			if (slabSize == SLAB_SIZE) {
+				flush();
+			}
+		}
 
-		if (memcpy_s(pointer.get(), size, data, size)) {
-			return false;
+		if (cacheEntryPointer) {
+			cacheEntryPointer->write(data, size);
 		}
 
-		// this locks the FileTask for a single line
-		// when it unlocks, the output thread will wake up to write the data
-		// then it will wait on more data again
-		fileTask.lock().get().emplace(size, pointer);
+		if (resultDataPointer) {
+			resultDataPointer->append((const char*)data, size);
+		}
 
 		this->size += size;
 	} catch (...) {
@@ -175,25 +208,40 @@ bool M4Revolution::OutputHandler::writeData(const void* data, int size) {
 	return true;
 }
 
-void M4Revolution::ErrorHandler::error(nvtt::Error error) {
-	consoleLog(nvtt::errorString(error), 2, false, true);
-	result = false;
-}
-
-void M4Revolution::waitFiles(Work::FileTask::POINTER_QUEUE::size_type fileTasks) {
-	// this function waits for the output thread to catch up
-	// if too many files are queued at once (to prevent running out of memory)
-	// this is only done on copying files so that it isn't run too often
-	if (fileTasks < maxFileTasks) {
+void M4Revolution::OutputHandler::flush() {
+	if (!slabSize) {
 		return;
 	}
 
-	// this is just some moderately small amount of time
-	const std::chrono::milliseconds MILLISECONDS(25);
+	// if the output thread leaves space for the file, anything past it would overwrite the file after this one
+	std::streamsize plannedSize = fileTask.getPlannedSize();
+
+	if (plannedSize != -1 && flushedSize + slabSize > (size_t)plannedSize) {
+		throw std::runtime_error("Failed to Fit Data in Planned Size");
+	}
+
+	std::streampos position = 0;
+	Work::Writer* writerPointer = fileTask.getPlacedWriterPointer(position);
+
+	if (writerPointer) {
+		// the output thread has left space for the file, so it's written there directly (and the slab is used again)
+		writerPointer->place(position + (std::streamoff)flushedSize, slabPointer.get(), slabSize);
+	} else {
+		// this doesn't wait on the memory budget, because the output thread may be waiting on this data
+		memoryGate.add(slabSize);
 
-	while (tasks.fileLock().get().size() >= maxFileTasks) {
-		std::this_thread::sleep_for(MILLISECONDS);
+		// if the output thread is waiting on this FileTask, it will wake up to write the data
+		// then it will wait on more data again
+		fileTask.emplace(slabSize, std::move(slabPointer));
 	}
+
+	flushedSize += slabSize;
+	slabSize = 0;
+}
+
+void M4Revolution::ErrorHandler::error(nvtt::Error error) {
+	consoleLog(nvtt::errorString(error), 2, false, true);
+	result = false;
 }
 
 void M4Revolution::copyFiles(
@@ -202,29 +250,28 @@ void M4Revolution::copyFiles(
 	Ubi::BigFile::File::SIZE inputCopyPosition,
 	Ubi::BigFile::File::POINTER_VECTOR_POINTER &filePointerVectorPointer,
 	std::streampos bigFileInputPosition,
+	const Work::BigFileTask::POINTER &bigFileTaskPointer,
 	Log &log
 ) {
 	inputStream.seekg((std::streampos)inputCopyPosition + bigFileInputPosition);
 
-	Work::FileTask::POINTER_QUEUE::size_type fileTasks = 0;
-
 	// note: this must get created even if filePointerVectorPointer is empty or the count to copy would be zero
-	// so that the bigFileInputPosition is reliably seen by the output thread
-	Work::FileTask::POINTER fileTaskPointer = std::make_shared<Work::FileTask>(bigFileInputPosition, filePointerVectorPointer);
+	// so that the BigFile is reliably seen by the output thread
+	Work::FileTask::POINTER fileTaskPointer = std::make_shared<Work::FileTask>(bigFileTaskPointer, filePointerVectorPointer, tasks.getOutputSignal());
 
-	// we grab files in this scope so we won't have to lock this twice unnecessarily
-	{
-		Work::FileTask::POINTER_QUEUE_LOCK fileLock = tasks.fileLock();
-		Work::FileTask::POINTER_QUEUE &queue = fileLock.get();
-		queue.push(fileTaskPointer);
-		fileTasks = queue.size();
-	}
+	tasks.enterFile();
+	fileLock().get().push_back(fileTaskPointer);
 
 	Work::FileTask &fileTask = *fileTaskPointer;
-	fileTask.copy(inputStream, inputPosition - inputCopyPosition);
-	fileTask.complete();
 
-	waitFiles(fileTasks);
+	MAKE_SCOPE_EXIT(stopFileScopeExit) {
+		stopFile(fileTask);
+	};
+
+	fileTask.copy(inputStream, inputPosition - inputCopyPosition, tasks.getMemoryGate());
+
+	stopFileScopeExit.dismiss();
+	fileTask.complete();
 
 	filePointerVectorPointer = std::make_shared<Ubi::BigFile::File::POINTER_VECTOR>();
 
@@ -233,36 +280,88 @@ void M4Revolution::copyFiles(
 
 void M4Revolution::convertFile(
 	std::istream &inputStream,
-	std::streampos ownerBigFileInputPosition,
+	const Work::BigFileTask::POINTER &ownerBigFileTaskPointer,
 	Ubi::BigFile::File &file,
 	Work::Convert::FileWorkCallback fileWorkCallback
 ) {
-	Work::Convert &convert = *new Work::Convert(configuration, context, file);
+	// this waits before reading the file, so the data waiting to be converted is limited too
+	tasks.enterFile();
+
+	MAKE_SCOPE_EXIT(enterFileScopeExit) {
+		tasks.leaveFile();
+	};
+
+	Work::Convert &convert = *new Work::Convert(configuration, context, file, tasks.getMemoryGate());
 
 	MAKE_SCOPE_EXIT(convertScopeExit) {
 		delete &convert;
 	};
 
-	Work::Data::POINTER &dataPointer = convert.dataPointer;
-	dataPointer = Work::Data::POINTER(new unsigned char[file.size]);
-	readStream(inputStream, dataPointer.get(), file.size);
+	convert.readData(inputStream);
+	convert.key = getKey(convert);
+
+	convert.cachePointer = cacheOptional.has_value()
+		? &cacheOptional.value()
+		: 0;
 
 	Work::FileTask::POINTER &fileTaskPointer = convert.fileTaskPointer;
-	fileTaskPointer = std::make_shared<Work::FileTask>(ownerBigFileInputPosition, &file);
-	tasks.fileLock().get().push(fileTaskPointer);
+	fileTaskPointer = std::make_shared<Work::FileTask>(ownerBigFileTaskPointer, &file, tasks.getOutputSignal());
+	fileLock().get().push_back(fileTaskPointer);
+
+	// now that it's queued, the output thread will let it out of the gate
+	enterFileScopeExit.dismiss();
+
+	// and until it's handed off to be converted, this has to make sure it's completed
+	MAKE_SCOPE_EXIT(stopFileScopeExit) {
+		stopFile(*fileTaskPointer);
+	};
+
+	Work::Result::POINTER &resultPointer = resultPointerMap[convert.key];
+
+	if (resultPointer) {
+		Work::Result::DATA_POINTER dataPointer = 0;
+
+		// if the file is a duplicate of one being converted, it's written out once that one is
+		if (resultPointer->wait({ fileTaskPointer, &file }, dataPointer)) {
+			stopFileScopeExit.dismiss();
+			return;
+		}
+
+		if (dataPointer) {
+			convert.freeData();
+
+			writeResult(*dataPointer, *fileTaskPointer, file, tasks.getMemoryGate());
+			stopFileScopeExit.dismiss();
+			return;
+		}
+
+		// there wasn't room to keep the result, so this one is converted again (and its result kept instead, if there is now)
+	}
+
+	resultPointer = std::make_shared<Work::Result>(tasks.getResultGate());
+	convert.resultPointer = resultPointer;
 
 	convert.fileWorkCallback = fileWorkCallback;
 
 	#ifdef MULTITHREADED
+	#ifdef WINDOWS
 	PTP_WORK work = CreateThreadpoolWork(convertFileProc, &convert, NULL);
 	osErr(work);
 
+	stopFileScopeExit.dismiss();
 	convertScopeExit.dismiss();
 
 	SubmitThreadpoolWork(work);
 	CloseThreadpoolWork(work);
+	#else
+	stopFileScopeExit.dismiss();
+	convertScopeExit.dismiss();
+
+	poolOptional.value().submit(convertFileProc, &convert);
+	#endif
 	#endif
 	#ifdef SINGLETHREADED
+	stopFileScopeExit.dismiss();
 	convertScopeExit.dismiss();
 
 	convert.fileWorkCallback(&convert);
@@ -272,6 +371,7 @@ void M4Revolution::convertFile(
 void M4Revolution::convertFile(
 	std::istream &inputStream,
 	std::streampos bigFileInputPosition,
+	const Work::BigFileTask::POINTER &bigFileTaskPointer,
 	Ubi::BigFile::File &file,
 	Log &log
 ) {
@@ -280,27 +380,54 @@ void M4Revolution::convertFile(
 	// these conversion functions update the file sizes passed in
 	switch (file.type) {
 		case Ubi::BigFile::File::TYPE::BIG_FILE:
-		fixLoading(inputStream, bigFileInputPosition, file, log);
+		#ifdef LINUX
+		// the BigFiles in the top BigFile are each written into a segment of their own
+		if (segmentedOutput && !segmentPointer && !bigFileTaskPointer->getOwnerBigFileTaskPointer()) {
+			fixLoadingSegment(inputStream, bigFileTaskPointer, file, log);
+			break;
+		}
+		#endif
+
+		fixLoading(inputStream, bigFileTaskPointer, file, log);
 		break;
 		case Ubi::BigFile::File::TYPE::IMAGE_STANDARD:
-		convertFile(inputStream, bigFileInputPosition, file, convertImageStandardWorkCallback);
+		convertFile(inputStream, bigFileTaskPointer, file, convertImageStandardWorkCallback);
 		break;
 		case Ubi::BigFile::File::TYPE::IMAGE_ZAP:
-		convertFile(inputStream, bigFileInputPosition, file, convertImageZAPWorkCallback);
+		convertFile(inputStream, bigFileTaskPointer, file, convertImageZAPWorkCallback);
 		break;
 		default:
 		// either a file we need to copy at the same position as ones we need to convert, or is a type not yet implemented
-		Work::FileTask::POINTER fileTaskPointer = std::make_shared<Work::FileTask>(bigFileInputPosition, &file);
-		tasks.fileLock().get().push(fileTaskPointer);
+		Work::FileTask::POINTER fileTaskPointer = std::make_shared<Work::FileTask>(bigFileTaskPointer, &file, tasks.getOutputSignal());
+
+		tasks.enterFile();
+		fileLock().get().push_back(fileTaskPointer);
 
 		Work::FileTask &fileTask = *fileTaskPointer;
-		fileTask.copy(inputStream, file.size);
+
+		MAKE_SCOPE_EXIT(stopFileScopeExit) {
+			stopFile(fileTask);
+		};
+
+		fileTask.copy(inputStream, file.size, tasks.getMemoryGate());
+
+		stopFileScopeExit.dismiss();
 		fileTask.complete();
 	}
 
 	log.converting(file);
 }
 
+// if a file can't be read in full, it's completed anyway so the output thread doesn't wait on it forever
+// but then the files after it are in the wrong place, so the journal stops before it
+void M4Revolution::stopFile(Work::FileTask &fileTask) {
+	if (journalOptional.has_value()) {
+		journalOptional.value().stop();
+	}
+
+	fileTask.complete();
+}
+
 void M4Revolution::stepFile(
 	Ubi::BigFile::File::SIZE inputPosition,
 	Ubi::BigFile::File::SIZE &inputFilePosition,
@@ -314,77 +441,107 @@ void M4Revolution::stepFile(
 	log.step();
 }
 
-void M4Revolution::fixLoading(std::istream &inputStream, std::streampos ownerBigFileInputPosition, Ubi::BigFile::File &file, Log &log) {
-	// filePointerSetMap is a map where the keys are the file positions beginning to end, and values are sets of files at that position
-	Ubi::BigFile::File::POINTER_SET_MAP filePointerSetMap = {};
+void M4Revolution::fixLoading(std::istream &inputStream, const Work::BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File &file, Log &log) {
 	std::streampos bigFileInputPosition = inputStream.tellg();
+	Work::BigFileTask::POINTER bigFileTaskPointer = 0;
+
+	const Work::Index::Entry* indexEntryPointer = indexOptional.has_value()
+		? indexOptional.value().find(bigFileInputPosition)
+		: 0;
+
+	if (indexEntryPointer) {
+		bigFileTaskPointer = std::make_shared<Work::BigFileTask>(
+			indexOptional.value(),
+			*indexEntryPointer,
+			ownerBigFileTaskPointer,
+			file
+		);
 
-	tasks.bigFileLock().get().insert(
-		{
-			bigFileInputPosition,
+		// the directory doesn't need to be read, so the stream skips straight to the files
+		inputStream.seekg(indexEntryPointer->directoryEndPosition);
+	} else if (inputMappedFileOptional.has_value()) {
+		const MappedFile &INPUT_MAPPED_FILE = inputMappedFileOptional.value();
+		Ubi::SpanReader spanReader(INPUT_MAPPED_FILE.getData(), INPUT_MAPPED_FILE.getSize(), (size_t)bigFileInputPosition);
 
-			std::make_shared<Work::BigFileTask>(
-				inputStream,
-				ownerBigFileInputPosition,
-				file,
-				filePointerSetMap
-			)
-		}
-	);
+		bigFileTaskPointer = std::make_shared<Work::BigFileTask>(
+			spanReader,
+			ownerBigFileTaskPointer,
+			file
+		);
+
+		// the stream picks up where the directory ended
+		inputStream.seekg(spanReader.tell());
+	} else {
+		bigFileTaskPointer = std::make_shared<Work::BigFileTask>(
+			inputStream,
+			ownerBigFileTaskPointer,
+			file
+		);
+	}
 
 	// inputCopyPosition is the position of the files to copy
 	// inputFilePosition is the position of a specific input file (for file.size calculation)
 	Ubi::BigFile::File::SIZE inputCopyPosition = (Ubi::BigFile::File::SIZE)(inputStream.tellg() - bigFileInputPosition);
 	Ubi::BigFile::File::SIZE inputFilePosition = inputCopyPosition;
 
-	// convert keeps track of if we just converted any files within the inner, set loop
+	// convert keeps track of if we just converted any files within the inner, position loop
 	// (in which case, inputCopyPosition is advanced)
 	// countCopy is the count of the bytes to copy when copying files
 	// filePointerVectorPointer is to communicate file sizes/positions to the output thread
 	bool convert = false;
 	Ubi::BigFile::File::POINTER_VECTOR_POINTER filePointerVectorPointer = std::make_shared<Ubi::BigFile::File::POINTER_VECTOR>();
 
-	for (
-		Ubi::BigFile::File::POINTER_SET_MAP::iterator filePointerSetMapIterator = filePointerSetMap.begin();
-		filePointerSetMapIterator != filePointerSetMap.end();
-		filePointerSetMapIterator++
-	) {
+	// the positionVector has the file positions beginning to end, with the files at the same position next to each other
+	Ubi::BigFile &bigFile = *bigFileTaskPointer->getBigFilePointer();
+	const Ubi::BigFile::Position::VECTOR &POSITION_VECTOR = bigFile.positionVector;
+	Ubi::BigFile::Position::VECTOR::const_iterator positionVectorIterator = POSITION_VECTOR.begin();
+
+	// if the top BigFile was partly written before being interrupted, carry on from where the journal says it got to
+	if (journalOptional.has_value() && !ownerBigFileTaskPointer) {
+		Ubi::BigFile::Position::VECTOR::size_type files = 0;
+
+		if (journalOptional.value().restore(bigFile, files, inputCopyPosition, inputFilePosition)) {
+			positionVectorIterator += files;
+		}
+	}
+
+	while (positionVectorIterator != POSITION_VECTOR.end()) {
+		const Ubi::BigFile::File::SIZE POSITION = positionVectorIterator->position;
+
 		if (convert) {
-			inputCopyPosition = filePointerSetMapIterator->first;
+			inputCopyPosition = POSITION;
 			inputFilePosition = inputCopyPosition;
 			convert = false;
 		}
 
-		// we need an inner loop with a set here in case there are identical files with different paths, at the same position
-		Ubi::BigFile::File::POINTER_SET &filePointerSet = filePointerSetMapIterator->second;
-
+		// we need an inner loop here in case there are identical files with different paths, at the same position
 		for (
-			Ubi::BigFile::File::POINTER_SET::iterator filePointerSetIterator = filePointerSet.begin();
-			filePointerSetIterator != filePointerSet.end();
-			filePointerSetIterator++
+			;
+			positionVectorIterator != POSITION_VECTOR.end() && positionVectorIterator->position == POSITION;
+			positionVectorIterator++
 		) {
-			Ubi::BigFile::File &file = **filePointerSetIterator;
+			Ubi::BigFile::File &file = bigFile.fileVector[positionVectorIterator->fileIndex];
 
 			// if we encounter a file we need to convert for the first time, then first copy the files before it
 			if (!convert && file.type != Ubi::BigFile::File::TYPE::NONE && file.type != Ubi::BigFile::File::TYPE::BINARY) {
-				file.padding = filePointerSetMapIterator->first - inputFilePosition;
+				file.padding = POSITION - inputFilePosition;
 
 				// prevent copying if there are no files (this is safe in this scenario only)
 				if (!filePointerVectorPointer->empty()) {
-					copyFiles(inputStream, filePointerSetMapIterator->first, inputCopyPosition, filePointerVectorPointer, bigFileInputPosition, log);
+					copyFiles(inputStream, POSITION, inputCopyPosition, filePointerVectorPointer, bigFileInputPosition, bigFileTaskPointer, log);
 				}
 
 				// we'll need to convert this file type
 				convert = true;
 			}
 
-			// if we are converting this or any previous file in the set
+			// if we are converting this or any previous file at this position
 			if (convert) {
-				convertFile(inputStream, bigFileInputPosition, file, log);
+				convertFile(inputStream, bigFileInputPosition, bigFileTaskPointer, file, log);
 			} else {
 				// other identical, copied files at the same position in the input should likewise be at the same position in the output
-				file.padding = filePointerSetMapIterator->first - inputFilePosition;
-				stepFile(filePointerSetMapIterator->first, inputFilePosition, filePointerVectorPointer, *filePointerSetIterator, log);
+				file.padding = POSITION - inputFilePosition;
+				stepFile(POSITION, inputFilePosition, filePointerVectorPointer, &file, log);
 			}
 		}
 	}
@@ -393,9 +550,86 @@ void M4Revolution::fixLoading(std::istream &inputStream, std::streampos ownerBig
 	if (!convert) {
 		// always copy here even if filePointerVectorPointer is empty
 		// (ensure every BigFile has at least one FileTask)
-		copyFiles(inputStream, file.size, inputCopyPosition, filePointerVectorPointer, bigFileInputPosition, log);
+		copyFiles(inputStream, file.size, inputCopyPosition, filePointerVectorPointer, bigFileInputPosition, bigFileTaskPointer, log);
+	}
+}
+
+#ifdef LINUX
+void M4Revolution::fixLoadingSegment(std::istream &inputStream, const Work::BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File &file, Log &log) {
+	// these must be 8.3 filenames, same as the ones for the top segment
+	std::string fileName = "";
+	std::string spillFileName = "";
+
+	{
+		std::ostringstream fileNameStream;
+		fileNameStream.exceptions(std::ostringstream::badbit);
+		fileNameStream << std::hex << std::uppercase << std::setfill('0') << std::setw(4) << segments++ << ".tmp";
+
+		const std::string &FILE_NAME = fileNameStream.str();
+		fileName = "~M4J" + FILE_NAME;
+		spillFileName = "~M4S" + FILE_NAME;
+	}
+
+	Work::Segment::POINTER segmentPointer = std::make_shared<Work::Segment>(fileName.c_str(), spillFileName.c_str());
+	Work::Segment &segment = *segmentPointer;
+
+	// this is started first, because the output thread joins it as soon as it gets to the BigFile
+	segment.thread = std::thread(M4Revolution::outputThread, std::ref(tasks), std::ref(segment), (Work::Journal*)0);
+
+	// until the BigFile is queued, nothing else will join the thread or remove its files
+	MAKE_SCOPE_EXIT(threadScopeExit) {
+		endSegment(segment, file);
+		segment.thread.join();
+
+		std::error_code errorCode = {};
+		std::filesystem::remove(segment.getFileName(), errorCode);
+	};
+
+	// the BigFile is queued in the top BigFile like any other file, and once its segment is written, it's copied in there
+	// (it doesn't enter the file gate, because then the files in the segment might wait on the output thread to copy it in)
+	Work::FileTask::POINTER fileTaskPointer = std::make_shared<Work::FileTask>(ownerBigFileTaskPointer, &file, segmentPointer, tasks.getOutputSignal());
+	fileTaskPointer->complete();
+	fileLock().get().push_back(fileTaskPointer);
+
+	threadScopeExit.dismiss();
+
+	// even if fixing loading fails, the segment is ended, so the top output thread can still join it
+	SCOPE_EXIT {
+		endSegment(segment, file);
+	};
+
+	{
+		this->segmentPointer = segmentPointer;
+
+		SCOPE_EXIT {
+			this->segmentPointer = 0;
+		};
+
+		// in its segment, the BigFile has no owner, so its output thread writes it as the top one
+		fixLoading(inputStream, 0, file, log);
 	}
 }
+#endif
+
+Work::FileTask::POINTER_QUEUE_LOCK M4Revolution::fileLock() {
+	#ifdef LINUX
+	if (segmentPointer) {
+		return segmentPointer->fileLock();
+	}
+	#endif
+	return tasks.getSegment().fileLock();
+}
+
+void M4Revolution::endSegment(Work::Segment &segment, Ubi::BigFile::File &file) {
+	// necessary to wake up the output thread one last time at the end
+	// (it has no owner, so the output thread knows it's the last one)
+	Work::BigFileTask::POINTER bigFileTaskPointer = 0;
+	Work::FileTask::POINTER fileTaskPointer = std::make_shared<Work::FileTask>(bigFileTaskPointer, &file, tasks.getOutputSignal());
+	fileTaskPointer->complete();
+	segment.fileLock().get().push_back(fileTaskPointer);
+
+	segment.yield = false;
+}
 
 const Ubi::BigFile::Path::VECTOR M4Revolution::TRANSITION_FADE_PATH_VECTOR = {
 	   {{"gamedata", "common"}, "common.m4b"},
@@ -652,6 +886,149 @@ Ubi::BigFile::File M4Revolution::createInputFile(std::istream &inputStream) {
 	return inputFile;
 }
 
+size_t M4Revolution::getSurfaceSize(const nvtt::Surface &surface) {
+	// surfaces are always four channels of floats, no matter what they were loaded from
+	const size_t CHANNELS = 4;
+
+	return (size_t)surface.width() * (size_t)surface.height() * (size_t)surface.depth() * CHANNELS * sizeof(float);
+}
+
+// what the file is converted from and how, so it can be found in the cache, or be found to be a duplicate
+std::string M4Revolution::getKey(const Work::Convert &convert) {
+	const Ubi::BigFile::File &file = convert.file;
+	const Work::Convert::Configuration &CONFIGURATION = convert.CONFIGURATION;
+
+	#ifdef EXTENTS_MAKE_SQUARE
+	const uint32_t OPTION_EXTENTS_MAKE_SQUARE = 0x00000001;
+	#endif
+
+	#ifdef EXTENTS_MAKE_POWER_OF_TWO
+	const uint32_t OPTION_EXTENTS_MAKE_POWER_OF_TWO = 0x00000002;
+	#endif
+
+	#ifdef TO_NEXT_POWER_OF_TWO
+	const uint32_t OPTION_TO_NEXT_POWER_OF_TWO = 0x00000004;
+	#endif
+
+	const uint32_t OPTION_CUDA_ACCELERATION = 0x00000008;
+
+	std::ostringstream keyStream(std::ios::binary);
+
+	Work::Cache::HASH dataHash = Work::Cache::hash(convert.dataPointer.get(), convert.dataSize);
+	writeStream(keyStream, &dataHash, sizeof(dataHash));
+
+	uint64_t dataSize = convert.dataSize;
+	writeStream(keyStream, &dataSize, sizeof(dataSize));
+
+	uint32_t type = (uint32_t)file.type;
+	writeStream(keyStream, &type, sizeof(type));
+
+	uint32_t rgba = file.rgba;
+	writeStream(keyStream, &rgba, sizeof(rgba));
+
+	uint32_t extents[] = {
+		(uint32_t)CONFIGURATION.minTextureWidth,
+		(uint32_t)CONFIGURATION.maxTextureWidth,
+		(uint32_t)CONFIGURATION.minTextureHeight,
+		(uint32_t)CONFIGURATION.maxTextureHeight,
+		(uint32_t)CONFIGURATION.minVolumeExtent,
+		(uint32_t)CONFIGURATION.maxVolumeExtent
+	};
+
+	writeStream(keyStream, extents, sizeof(extents));
+
+	uint32_t options = 0;
+
+	#ifdef EXTENTS_MAKE_SQUARE
+	options |= OPTION_EXTENTS_MAKE_SQUARE;
+	#endif
+
+	#ifdef EXTENTS_MAKE_POWER_OF_TWO
+	options |= OPTION_EXTENTS_MAKE_POWER_OF_TWO;
+	#endif
+
+	#ifdef TO_NEXT_POWER_OF_TWO
+	options |= OPTION_TO_NEXT_POWER_OF_TWO;
+	#endif
+
+	// compressing on the GPU doesn't give exactly the same result as on the CPU
+	if (convert.CONTEXT.isCudaAccelerationEnabled()) {
+		options |= OPTION_CUDA_ACCELERATION;
+	}
+
+	writeStream(keyStream, &options, sizeof(options));
+
+	uint32_t version = nvtt::version();
+	writeStream(keyStream, &version, sizeof(version));
+
+	return keyStream.str();
+}
+
+// writes out what a file was converted to before, instead of converting it
+void M4Revolution::writeResult(const std::string &data, Work::FileTask &fileTask, Ubi::BigFile::File &file, Work::Gate &memoryGate) {
+	file.size = (Ubi::BigFile::File::SIZE)data.size();
+
+	#ifdef PLANNED_LAYOUT
+	fileTask.plan(file.size);
+	#endif
+
+	OutputHandler outputHandler(fileTask, memoryGate);
+
+	if (!outputHandler.writeData(data.data(), (int)data.size())) {
+		throw std::runtime_error("Failed to Write Result Data");
+	}
+
+	outputHandler.flush();
+	fileTask.complete();
+}
+
+// any duplicates that were waiting on the file are written out now that it's been converted
+void M4Revolution::completeResult(Work::Convert &convert, const Work::Result::DATA_POINTER &dataPointer) {
+	if (!convert.resultPointer) {
+		return;
+	}
+
+	Work::Result::Duplicate::VECTOR duplicateVector = convert.resultPointer->complete(dataPointer);
+
+	for (
+		Work::Result::Duplicate::VECTOR::iterator duplicateVectorIterator = duplicateVector.begin();
+		duplicateVectorIterator != duplicateVector.end();
+		duplicateVectorIterator++
+	) {
+		writeResult(*dataPointer, *duplicateVectorIterator->fileTaskPointer, *duplicateVectorIterator->filePointer, convert.memoryGate);
+	}
+}
+
+// if the file was converted the same way before, what it was converted to is written out instead of converting it again
+bool M4Revolution::readCache(Work::Convert &convert) {
+	Work::Cache* cachePointer = convert.cachePointer;
+
+	if (!cachePointer) {
+		return false;
+	}
+
+	std::string data = "";
+
+	if (!cachePointer->find(convert.key, data)) {
+		return false;
+	}
+
+	Work::Gate &memoryGate = convert.memoryGate;
+	const size_t DATA_SIZE = data.size();
+	memoryGate.add(DATA_SIZE);
+
+	SCOPE_EXIT {
+		memoryGate.leave(DATA_SIZE);
+	};
+
+	convert.freeData();
+
+	Work::Result::DATA_POINTER dataPointer = std::make_shared<const std::string>(std::move(data));
+	writeResult(*dataPointer, *convert.fileTaskPointer, convert.file, memoryGate);
+	completeResult(convert, dataPointer);
+	return true;
+}
+
 void M4Revolution::convertSurface(Work::Convert &convert, nvtt::Surface &surface, bool hasAlpha) {
 	const Work::Convert::Configuration &CONFIGURATION = convert.CONFIGURATION;
 
@@ -699,9 +1076,23 @@ void M4Revolution::convertSurface(Work::Convert &convert, nvtt::Surface &surface
 
 	Work::FileTask &fileTask = *convert.fileTaskPointer;
 
-	OutputHandler outputHandler(fileTask);
+	OutputHandler outputHandler(fileTask, convert.memoryGate);
 	outputOptions.setOutputHandler(&outputHandler);
 
+	// the entry is only kept if the whole file was converted
+	std::optional<Work::Cache::Entry> cacheEntryOptional = std::nullopt;
+
+	if (convert.cachePointer) {
+		outputHandler.cacheEntryPointer = &cacheEntryOptional.emplace(*convert.cachePointer, convert.key);
+	}
+
+	// if duplicates of the file are found, this is written out for them too
+	std::string resultData = "";
+
+	if (convert.resultPointer) {
+		outputHandler.resultDataPointer = &resultData;
+	}
+
 	ErrorHandler errorHandler;
 	outputOptions.setErrorHandler(&errorHandler);
 
@@ -709,16 +1100,49 @@ void M4Revolution::convertSurface(Work::Convert &convert, nvtt::Surface &surface
 		throw std::runtime_error("Failed to Output Context Header");
 	}
 
+	#ifdef PLANNED_LAYOUT
+	// if the size only depends on the extents now, the output thread can leave space for it
+	// but only if none of the header has been handed off yet, because that data is written in order
+	// (otherwise, such as for RGBA, it's written in order like any other file)
+	bool planned = M4Revolution::COMPRESSION_OPTIONS.isBlockCompressed(COMPRESSION_OPTIONS) && !outputHandler.flushedSize;
+
+	if (planned) {
+		file.size = outputHandler.size + CONTEXT.estimateSize(surface, MIPMAP_COUNT, COMPRESSION_OPTIONS);
+		fileTask.plan(file.size);
+	}
+	#endif
+
 	for (int i = 0; i < MIPMAP_COUNT; i++) {
 		if (!CONTEXT.compress(surface, 0, i, COMPRESSION_OPTIONS, outputOptions) || !errorHandler.result) {
 			throw std::runtime_error("Failed to Compress Context");
 		}
 	}
 
+	#ifdef PLANNED_LAYOUT
+	if (planned) {
+		// the file after this one may already be written, so it must fill exactly the space that was left
+		if (outputHandler.size != file.size) {
+			throw std::runtime_error("Failed to Compress Context to Planned Size");
+		}
+	} else {
+		file.size = outputHandler.size;
+	}
+	#else
 	file.size = outputHandler.size;
+	#endif
+
+	// the last slab is usually only partly full, so it's handed off now
+	outputHandler.flush();
+
+	// this happens before completing the FileTask, so the entry is never still being committed once fixing loading is done
+	if (cacheEntryOptional.has_value()) {
+		cacheEntryOptional.value().commit();
+	}
 
 	// this will wake up the output thread to tell it we have no more data to add, and to move on to the next FileTask
 	fileTask.complete();
+
+	completeResult(convert, std::make_shared<const std::string>(std::move(resultData)));
 }
 
 void M4Revolution::convertImageStandardWorkCallback(Work::Convert* convertPointer) {
@@ -727,6 +1151,11 @@ void M4Revolution::convertImageStandardWorkCallback(Work::Convert* convertPointe
 	};
 
 	Work::Convert &convert = *convertPointer;
+
+	if (readCache(convert)) {
+		return;
+	}
+
 	nvtt::Surface surface = {};
 	bool hasAlpha = true;
 
@@ -734,6 +1163,17 @@ void M4Revolution::convertImageStandardWorkCallback(Work::Convert* convertPointe
 		throw std::runtime_error("Failed to Load Surface From Memory");
 	}
 
+	// the file isn't needed now that it's loaded, but the surface counts against the memory budget for as long as it's around
+	Work::Gate &memoryGate = convert.memoryGate;
+	const size_t SURFACE_SIZE = getSurfaceSize(surface);
+	memoryGate.add(SURFACE_SIZE);
+
+	SCOPE_EXIT {
+		memoryGate.leave(SURFACE_SIZE);
+	};
+
+	convert.freeData();
+
 	// when this unlocks one line later, the output thread will begin waiting on data
 	convertSurface(convert, surface, hasAlpha);
 }
@@ -744,6 +1184,12 @@ void M4Revolution::convertImageZAPWorkCallback(Work::Convert* convertPointer) {
 	};
 
 	Work::Convert &convert = *convertPointer;
+
+	if (readCache(convert)) {
+		return;
+	}
+
+	Work::Gate &memoryGate = convert.memoryGate;
 	nvtt::Surface surface = {};
 
 	{
@@ -759,12 +1205,19 @@ void M4Revolution::convertImageZAPWorkCallback(Work::Convert* convertPointer) {
 			throw std::runtime_error("Failed to Load ZAP From Memory");
 		}
 
+		// like with the surface, the image counts against the memory budget for as long as it's around
+		memoryGate.add(size);
+
 		SCOPE_EXIT {
+			memoryGate.leave(size);
+
 			if (!freeZAP(image)) {
 				throw std::runtime_error("Failed to Free ZAP");
 			}
 		};
 
+		convert.freeData();
+
 		const int DEPTH = 1;
 
 		if (!surface.setImage(nvtt::InputFormat::InputFormat_BGRA_8UB, width, height, DEPTH, image)) {
@@ -772,157 +1225,226 @@ void M4Revolution::convertImageZAPWorkCallback(Work::Convert* convertPointer) {
 		}
 	}
 
+	const size_t SURFACE_SIZE = getSurfaceSize(surface);
+	memoryGate.add(SURFACE_SIZE);
+
+	SCOPE_EXIT {
+		memoryGate.leave(SURFACE_SIZE);
+	};
+
 	// when this unlocks one line later, the output thread will begin waiting on data
 	convertSurface(convert, surface, true);
 }
 
 #ifdef MULTITHREADED
+#ifdef WINDOWS
 VOID CALLBACK M4Revolution::convertFileProc(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work) {
 	Work::Convert* convertPointer = (Work::Convert*)parameter;
 	convertPointer->fileWorkCallback(convertPointer);
 }
+#else
+void M4Revolution::convertFileProc(void* parameter) {
+	Work::Convert* convertPointer = (Work::Convert*)parameter;
+	convertPointer->fileWorkCallback(convertPointer);
+}
+#endif
 #endif
 
-bool M4Revolution::outputBigFiles(Work::Output &output, std::streampos bigFileInputPosition, Work::Tasks &tasks) {
-	std::streampos &currentBigFileInputPosition = output.currentBigFileInputPosition;
-
-	// if this is true we haven't moved on to another BigFile, so just return immediately
-	if (bigFileInputPosition == currentBigFileInputPosition) {
-		return true;
+// leaves space for the filesystem of the BigFile (and any that own it) if nothing has been written to it yet
+// the ones that own it go first, because the files of a BigFile may come before any other files of the one that owns it
+void M4Revolution::enterBigFiles(Work::Writer &writer, Work::BigFileTask &bigFileTask) {
+	if (bigFileTask.outputPosition != -1) {
+		return;
 	}
 
-	std::ofstream &fileStream = output.fileStream;
-	Work::BigFileTask::POINTER &bigFileTaskPointer = output.bigFileTaskPointer;
-	Ubi::BigFile::File::SIZE &filePosition = output.filePosition;
-	Ubi::BigFile::File::POINTER_VECTOR::size_type &filesWritten = output.filesWritten;
+	Work::BigFileTask::POINTER ownerBigFileTaskPointer = bigFileTask.getOwnerBigFileTaskPointer();
 
-	Ubi::BigFile::File::POINTER_VECTOR::size_type files = 0;
+	if (ownerBigFileTaskPointer) {
+		enterBigFiles(writer, *ownerBigFileTaskPointer);
+	}
 
-	Work::BigFileTask::POINTER eraseBigFileTaskPointer = 0;
-	Work::BigFileTask::POINTER currentBigFileTaskPointer = 0;
+	bigFileTask.outputPosition = writer.tell();
+	bigFileTask.filePosition = bigFileTask.getFileSystemSize();
+	writer.fill(bigFileTask.filePosition);
+}
 
-	std::streampos eraseBigFileInputPosition = -1;
+// writes the filesystem of the BigFile once all of its files are written
+// then, because that is one of the files of the BigFile that owns it, does the same for that one, and so on
+// at the end, whatever filesystems are left are written regardless
+void M4Revolution::outputBigFiles(Work::Writer &writer, Work::BigFileTask::POINTER bigFileTaskPointer, bool end) {
+	Work::BigFileTask::POINTER ownerBigFileTaskPointer = 0;
 	std::streampos currentOutputPosition = -1;
 
-	// may be zero if this is the first BigFile so this hasn't been set before
-	if (bigFileTaskPointer) {
+	while (bigFileTaskPointer) {
 		Work::BigFileTask &bigFileTask = *bigFileTaskPointer;
-		files = bigFileTask.getFiles();
+		ownerBigFileTaskPointer = bigFileTask.getOwnerBigFileTaskPointer();
 
-		// checks if divisible, in case same BigFile referenced from multiple locations
-		if (files && (!filesWritten || filesWritten % files)) {
-			// we might be coming back to this BigFile later
-			// so set the number of files we've written
-			bigFileTask.filesWritten = filesWritten;
-		} else {
-			do {
-				// we're done with this BigFile, so
-				// write it, then erase it
-				eraseBigFileTaskPointer = bigFileTaskPointer;
-				Work::BigFileTask &eraseBigFileTask = *eraseBigFileTaskPointer;
+		if (!bigFileTask.written) {
+			if (!end && bigFileTask.filesWritten < bigFileTask.getFiles()) {
+				return;
+			}
 
-				// jump to the beginning where the filesystem is meant to be
-				// then jump to the end again
-				currentOutputPosition = fileStream.tellp();
+			// write the filesystem at the beginning where it's meant to be
+			// (without moving from the end, so the data after it is undisturbed)
+			currentOutputPosition = writer.tell();
 
-				std::streampos &eraseOutputPosition = eraseBigFileTask.outputPosition;
-				fileStream.seekp(eraseOutputPosition);
+			{
+				std::ostringstream fileSystemStream(std::ios::binary);
+				fileSystemStream.exceptions(std::ostringstream::badbit);
+				bigFileTask.getBigFilePointer()->write(fileSystemStream);
 
-				eraseBigFileTask.getBigFilePointer()->write(fileStream);
+				const std::string &FILE_SYSTEM = fileSystemStream.str();
+				writer.write(bigFileTask.outputPosition, FILE_SYSTEM.data(), FILE_SYSTEM.size());
+			}
 
-				fileStream.seekp(currentOutputPosition);
+			bigFileTask.written = true;
 
-				eraseBigFileInputPosition = currentBigFileInputPosition;
-				currentBigFileInputPosition = eraseBigFileTask.getOwnerBigFileInputPosition();
+			// the top BigFile has no owner to update
+			if (!ownerBigFileTaskPointer) {
+				return;
+			}
 
-				{
-					Work::BigFileTask::POINTER_MAP_LOCK bigFileLock = tasks.bigFileLock();
-					Work::BigFileTask::POINTER_MAP &bigFileTaskPointerMap = bigFileLock.get();
+			Work::BigFileTask &ownerBigFileTask = *ownerBigFileTaskPointer;
 
-					bigFileTaskPointerMap.erase(eraseBigFileInputPosition);
+			// update the size and position in the owner's filesystem
+			Ubi::BigFile::File &file = bigFileTask.getFile();
+			file.size = (Ubi::BigFile::File::SIZE)(currentOutputPosition - bigFileTask.outputPosition);
+			file.position = (Ubi::BigFile::File::SIZE)(bigFileTask.outputPosition - ownerBigFileTask.outputPosition);
+			ownerBigFileTask.filePosition = file.size + file.position;
+			ownerBigFileTask.filesWritten++;
+		}
 
-					// if the BigFile owns itself that means it's the top, and we're done
-					if (eraseBigFileInputPosition == currentBigFileInputPosition) {
-						return false;
-					}
+		bigFileTaskPointer = ownerBigFileTaskPointer;
+	}
+}
 
-					// since we're already holding the lock, might as well get this now
-					currentBigFileTaskPointer = bigFileTaskPointerMap.at(bigFileInputPosition);
-					bigFileTaskPointer = bigFileTaskPointerMap.at(currentBigFileInputPosition);
-				}
+bool M4Revolution::takeFiles(Work::FileTask::POINTER_QUEUE &fileTaskPointerQueue, Work::Reorder &reorder, Work::Writer &writer, Work::Segment &segment) {
+	// get any FileTasks queued since, so that they can be taken from as well
+	{
+		Work::FileTask::POINTER_QUEUE_LOCK fileLock = segment.fileLock();
+		Work::FileTask::POINTER_QUEUE &queue = fileLock.get();
 
-				// we now need to check the owner in case we are the last file in the owner and now all its files are written
-				Work::BigFileTask &ownerBigFileTask = *bigFileTaskPointer;
+		fileTaskPointerQueue.insert(fileTaskPointerQueue.end(), queue.begin(), queue.end());
+		queue = {};
+	}
 
-				// update the size and position in the owner's filesystem
-				Ubi::BigFile::File &file = eraseBigFileTask.getFile();
-				file.size = (Ubi::BigFile::File::SIZE)(currentOutputPosition - eraseOutputPosition);
-				file.position = (Ubi::BigFile::File::SIZE)(eraseOutputPosition - ownerBigFileTask.outputPosition);
-				filePosition = file.size + file.position;
-				ownerBigFileTask.filesWritten++;
+	// the FileTasks that were placed can be written at any time, regardless of which one is first
+	bool taken = reorder.takePlaced(writer);
 
-				files = bigFileTaskPointer->getFiles();
-			} while (!files || (bigFileTaskPointer->filesWritten && !(bigFileTaskPointer->filesWritten % files)));
+	// the first FileTask is skipped, because that's the one being written
+	for (
+		Work::FileTask::POINTER_QUEUE::iterator fileTaskPointerQueueIterator = fileTaskPointerQueue.begin() + 1;
+		fileTaskPointerQueueIterator != fileTaskPointerQueue.end();
+		fileTaskPointerQueueIterator++
+	) {
+		Work::FileTask &fileTask = **fileTaskPointerQueueIterator;
+
+		#ifdef LINUX
+		// a segment has no data to take, and it's never written through the reorder, so it would never be let go of
+		// (then another FileTask made at the same address would be mistaken for it)
+		if (fileTask.getSegmentPointer()) {
+			continue;
 		}
-	}
+		#endif
 
-	// get the current BigFile now, if we didn't before already
-	currentBigFileInputPosition = bigFileInputPosition;
-	bigFileTaskPointer = currentBigFileTaskPointer ? currentBigFileTaskPointer : tasks.bigFileLock().get().at(currentBigFileInputPosition);
-	Work::BigFileTask &currentBigFileTask = *bigFileTaskPointer;
+		if (reorder.take(fileTask)) {
+			taken = true;
+		}
+	}
+	return taken;
+}
 
-	// get files written in case we are coming back to this BigFile from before
-	filesWritten = currentBigFileTask.filesWritten;
+void M4Revolution::outputData(Work::Output &output, Work::FileTask::POINTER_QUEUE &fileTaskPointerQueue, Work::Reorder &reorder, Work::Tasks &tasks, Work::Segment &segment) {
+	Work::Writer &writer = output.writerOptional.value();
+	Work::Gate &memoryGate = tasks.getMemoryGate();
+	Work::Signal &outputSignal = tasks.getOutputSignal();
 
-	if (!filesWritten) {
-		// if we've not written any files for this BigFile yet
-		// then we are at the beginning of it, so seek ahead
-		// so that there is space for the filesystem later
-		currentBigFileTask.outputPosition = fileStream.tellp();
+	// (this is a pointer, because the queue may grow while we're taking from the FileTasks after this one)
+	Work::FileTask::POINTER fileTaskPointer = fileTaskPointerQueue.front();
+	Work::FileTask &fileTask = *fileTaskPointer;
 
-		filePosition = currentBigFileTask.getFileSystemSize();
-		fileStream.seekp(filePosition, std::ios::cur);
+	#ifdef PLANNED_LAYOUT
+	// if we already know how big the file will be, leave space for it and move on
+	if (fileTask.getPlannedSize() != -1) {
+		reorder.place(fileTaskPointer, writer);
+		return;
 	}
-	return true;
-}
 
-void M4Revolution::outputData(std::ostream &outputStream, Work::FileTask &fileTask, bool &yield) {
-	Work::Data::QUEUE dataQueue = {};
+	// once any of the data is written in order, the rest of it must be as well
+	bool written = false;
+	#endif
 
-	for (;;) {
-		// copy out the queue
-		// this is fast since data is just a struct with a number and pointer
-		// (this is several times faster than holding the lock while writing)
-		{
-			Work::Data::QUEUE_LOCK lock = fileTask.lock(yield);
-			Work::Data::QUEUE &queue = lock.get();
+	// first write anything that was taken from this FileTask while others were being written
+	if (!reorder.write(fileTask, writer)) {
+		const size_t BUFFER_SIZE = Work::Writer::BUFFER_SIZE;
 
-			if (queue.empty()) {
-				continue;
-			}
+		Work::Data data = {};
+		Work::Data::VECTOR dataVector = {};
+		size_t dataVectorSize = 0;
+		bool completed = false;
+		Work::Signal::COUNT signalCount = 0;
 
-			dataQueue = queue;
-			queue = {};
-		}
+		for (;;) {
+			signalCount = outputSignal.get();
 
-		while (!dataQueue.empty()) {
-			Work::Data &data = dataQueue.front();
+			// gather whatever data is ready (up to a buffer's worth) so it can all be written at once
+			while (dataVectorSize < BUFFER_SIZE && fileTask.tryPop(data)) {
+				// a null pointer signals that the file is complete
+				if (!data.pointer) {
+					completed = true;
+					break;
+				}
 
-			// a null pointer signals that the file is complete
-			if (!data.pointer) {
-				return;
+				dataVectorSize += data.size;
+				dataVector.push_back(std::move(data));
 			}
 
-			writeStream(outputStream, data.pointer.get(), data.size);
+			if (!dataVector.empty()) {
+				writer.write(dataVector);
+
+				// now that it's written, the slabs go back to be used again, and no longer count against the memory budget
+				dataVector.clear();
+				memoryGate.leave(dataVectorSize);
+				dataVectorSize = 0;
+
+				#ifdef PLANNED_LAYOUT
+				written = true;
+				#endif
+			} else if (!completed) {
+				#ifdef PLANNED_LAYOUT
+				if (!written && fileTask.getPlannedSize() != -1) {
+					reorder.place(fileTaskPointer, writer);
+					return;
+				}
+				#endif
 
-			dataQueue.pop();
+				// instead of waiting on this FileTask, take whatever the ones after it have ready
+				// and only if none of them have anything either, wait until any of them do
+				// (unless what was taken before is using up the memory budget, then it's spilled first, so more can be read)
+				if (!takeFiles(fileTaskPointerQueue, reorder, writer, segment) && !reorder.spill()) {
+					outputSignal.wait(signalCount);
+				}
+			}
+
+			if (completed) {
+				break;
+			}
 		}
 	}
+
+	#ifdef LINUX
+	// copied data is passed through instead (there's no other data in that case)
+	std::streamsize passthroughCount = fileTask.getPassthroughCount();
+
+	if (passthroughCount) {
+		writer.passthrough(fileTask.getPassthroughInputPosition(), passthroughCount);
+	}
+	#endif
 }
 
-void M4Revolution::outputFiles(Work::Output &output, Work::FileTask::FILE_VARIANT &fileVariant) {
-	Ubi::BigFile::File::SIZE &filePosition = output.filePosition;
-	Ubi::BigFile::File::POINTER_VECTOR::size_type &filesWritten = output.filesWritten;
+void M4Revolution::outputFiles(Work::BigFileTask &bigFileTask, Work::FileTask::FILE_VARIANT &fileVariant) {
+	Ubi::BigFile::File::SIZE &filePosition = bigFileTask.filePosition;
+	Ubi::BigFile::File::POINTER_VECTOR::size_type &filesWritten = bigFileTask.filesWritten;
 
 	// depending on if the files was copied or converted
 	// we will either have a vector or a singular dataPointer
@@ -952,45 +1474,184 @@ void M4Revolution::outputFiles(Work::Output &output, Work::FileTask::FILE_VARIAN
 	}
 }
 
-void M4Revolution::outputThread(Work::Tasks &tasks, bool &yield) {
-	Work::Output output;
+#ifdef PLANNED_LAYOUT
+// waits for the files that were placed to be converted, writing their data as it comes
+void M4Revolution::outputPlaced(Work::Writer &writer, Work::Reorder &reorder, Work::Signal &outputSignal) {
+	Work::Signal::COUNT signalCount = 0;
+
+	while (reorder.getPlaced()) {
+		signalCount = outputSignal.get();
+
+		if (!reorder.takePlaced(writer)) {
+			outputSignal.wait(signalCount);
+		}
+	}
+}
+#endif
+
+#ifdef LINUX
+void M4Revolution::outputSegment(Work::Writer &writer, Work::Reorder &reorder, Work::Signal &outputSignal, Work::BigFileTask &bigFileTask, Work::Segment &segment, Ubi::BigFile::File &file) {
+	#ifdef PLANNED_LAYOUT
+	// the files placed before the segment may have data the reading thread is waiting on, so they're finished first
+	// (the reading thread is queueing the files of the segment, so it can't finish until the reading thread can go on)
+	outputPlaced(writer, reorder, outputSignal);
+	#endif
+
+	// the segment must be completely written before it can be copied in
+	segment.thread.join();
+
+	// it starts on a block boundary, so the filesystem may share its blocks instead of copying them
+	const std::streamoff ALIGNMENT = 0x1000;
+
+	writer.fill((ALIGNMENT - (std::streamoff)writer.tell() % ALIGNMENT) % ALIGNMENT);
+
+	std::streampos outputPosition = writer.tell();
+	std::streamsize size = writer.stitch(segment.getFileName());
+	std::filesystem::remove(segment.getFileName());
+
+	// the segment is the whole BigFile, so its size and position in the owner's filesystem are known now
+	file.size = (Ubi::BigFile::File::SIZE)size;
+	file.position = (Ubi::BigFile::File::SIZE)(outputPosition - bigFileTask.outputPosition);
+	bigFileTask.filePosition = file.size + file.position;
+	bigFileTask.filesWritten++;
+}
+#endif
+
+void M4Revolution::outputThread(Work::Tasks &tasks, Work::Segment &segment, Work::Journal* journalPointer) {
+	// this isn't opened until the first file, because until then fixLoading may still throw out the checkpoint
+	std::optional<Work::Output> outputOptional = std::nullopt;
 
 	Work::FileTask::POINTER_QUEUE fileTaskPointerQueue = {};
+	Work::Reorder reorder(tasks.getMemoryGate(), segment.getSpillFileName());
+	Work::Signal &outputSignal = tasks.getOutputSignal();
 
 	for (;;) {
+		#ifdef PLANNED_LAYOUT
+		// while any placed FileTasks are still being converted, this doesn't wait for more FileTasks, only for more data
+		// (whatever was added to them before they were placed may be what the reading thread is waiting on to queue more)
+		Work::Signal::COUNT signalCount = outputSignal.get();
+		bool placed = reorder.getPlaced();
+		#else
+		bool placed = false;
+		#endif
+
 		// copy out the queue
 		// (this is fast because it's just a queue of pointers, much faster than holding the lock while writing)
 		{
-			Work::FileTask::POINTER_QUEUE_LOCK fileLock = tasks.fileLock(yield);
+			Work::FileTask::POINTER_QUEUE_LOCK fileLock = placed ? segment.fileLock() : segment.fileLock(segment.yield);
 			Work::FileTask::POINTER_QUEUE &queue = fileLock.get();
 
 			if (queue.empty()) {
-				if (yield) {
-					continue;
-				}
-
 				// this would mean we made it to the end, but didn't write all the filesystems somehow
-				throw std::logic_error("queue must not be empty if yield is false");
+				if (!segment.yield) {
+					throw std::logic_error("queue must not be empty if yield is false");
+				}
+			} else {
+				fileTaskPointerQueue = queue;
+				queue = {};
 			}
+		}
 
-			fileTaskPointerQueue = queue;
-			queue = {};
+		if (fileTaskPointerQueue.empty()) {
+			#ifdef PLANNED_LAYOUT
+			if (placed && !reorder.takePlaced(outputOptional.value().writerOptional.value())) {
+				outputSignal.wait(signalCount);
+			}
+			#endif
+			continue;
 		}
 
 		while (!fileTaskPointerQueue.empty()) {
 			Work::FileTask &fileTask = *fileTaskPointerQueue.front();
+			Work::BigFileTask::POINTER bigFileTaskPointer = fileTask.getOwnerBigFileTaskPointer();
+
+			if (!outputOptional.has_value()) {
+				const Work::Journal::Checkpoint* checkpointPointer = journalPointer && journalPointer->getCheckpointOptional().has_value()
+					? &journalPointer->getCheckpointOptional().value()
+					: 0;
+
+				if (!checkpointPointer) {
+					outputOptional.emplace(segment.getFileName(), 0, tasks.getQueueDepth());
+				} else {
+					outputOptional.emplace(segment.getFileName(), checkpointPointer->outputPosition, tasks.getQueueDepth());
+
+					// pick up in the top BigFile, as if the files before the checkpoint were just written
+					// (the top BigFile is the one without an owner)
+					Work::BigFileTask::POINTER topBigFileTaskPointer = bigFileTaskPointer;
+
+					while (topBigFileTaskPointer && topBigFileTaskPointer->getOwnerBigFileTaskPointer()) {
+						topBigFileTaskPointer = topBigFileTaskPointer->getOwnerBigFileTaskPointer();
+					}
+
+					if (topBigFileTaskPointer) {
+						Work::BigFileTask &topBigFileTask = *topBigFileTaskPointer;
+						topBigFileTask.outputPosition = 0;
+						topBigFileTask.filePosition = checkpointPointer->filePosition;
+						topBigFileTask.filesWritten = checkpointPointer->fileVector.size();
+					}
+				}
+
+				#ifdef LINUX
+				outputOptional.value().writerOptional.value().openPassthrough(Work::Output::DATA_PATH);
+				#endif
+			}
+
+			Work::Output &output = outputOptional.value();
+			Work::Writer &writer = output.writerOptional.value();
+
+			// the last FileTask has no owner, which means we're done
+			if (!bigFileTaskPointer) {
+				// anything not written by now won't be getting any more files
+				outputBigFiles(writer, output.bigFileTaskPointer, true);
+
+				#ifdef PLANNED_LAYOUT
+				// the files that were placed may still be being converted, so wait for them to be written
+				outputPlaced(writer, reorder, outputSignal);
+				#endif
 
-			// if this returns false it means we're done
-			if (!outputBigFiles(output, fileTask.getOwnerBigFileInputPosition(), tasks)) {
+				writer.flush();
 				return;
 			}
 
-			outputData(output.fileStream, fileTask, yield);
+			Work::BigFileTask &bigFileTask = *bigFileTaskPointer;
+			enterBigFiles(writer, bigFileTask);
+			output.bigFileTaskPointer = bigFileTaskPointer;
 
 			Work::FileTask::FILE_VARIANT fileVariant = fileTask.getFileVariant();
-			outputFiles(output, fileVariant);
 
-			fileTaskPointerQueue.pop();
+			#ifdef LINUX
+			Work::Segment::POINTER segmentPointer = fileTask.getSegmentPointer();
+
+			if (segmentPointer) {
+				outputSegment(writer, reorder, outputSignal, bigFileTask, *segmentPointer, *std::get<Ubi::BigFile::File*>(fileVariant));
+			} else
+			#endif
+			{
+				outputData(output, fileTaskPointerQueue, reorder, tasks, segment);
+				outputFiles(bigFileTask, fileVariant);
+
+				// the file is written, so another can take its place
+				tasks.leaveFile();
+			}
+
+			// that may have been the last file of the BigFile, or the BigFiles that own it
+			outputBigFiles(writer, bigFileTaskPointer, false);
+
+			// everything in the journal must already be in the output file, so it's flushed first
+			// (and if any files that were placed are still being converted, it'll have to wait until the next one)
+			if (journalPointer && !bigFileTask.getOwnerBigFileTaskPointer() && !reorder.getPlaced()) {
+				writer.flush();
+
+				journalPointer->write(
+					*bigFileTask.getBigFilePointer(),
+					bigFileTask.filesWritten,
+					writer.tell(),
+					bigFileTask.filePosition,
+					std::holds_alternative<Ubi::BigFile::File::POINTER_VECTOR_POINTER>(fileVariant)
+				);
+			}
+
+			fileTaskPointerQueue.pop_front();
 		}
 	}
 }
@@ -1083,40 +1744,72 @@ M4Revolution::M4Revolution(
 	const std::filesystem::path &path,
 	bool logFileNames,
 	bool disableHardwareAcceleration,
+	bool cacheConvertedFiles,
 	uint32_t maxThreads,
 	Work::FileTask::POINTER_QUEUE::size_type maxFileTasks,
+	size_t memoryBudget,
+	unsigned int queueDepth,
+	bool segmentedOutput,
 	std::optional<Work::Convert::Configuration> configurationOptional
 )
-	: logFileNames(logFileNames) {
+	: logFileNames(logFileNames),
+	cacheConvertedFiles(cacheConvertedFiles) {
 	// here we make the path lexically normal just so that it displays nice
 	Work::Output::findInstallPath(path.lexically_normal());
 
 	context.enableCudaAcceleration(!disableHardwareAcceleration);
 
 	#ifdef MULTITHREADED
-	pool = CreateThreadpool(NULL);
-	osErr(pool);
-
 	if (!maxThreads) {
 		// chosen so that if you have a quad core there will still be at least two threads for other system stuff
 		// (meanwhile, barely affecting even more powerful processors)
-		const DWORD RESERVED_THREADS = 2;
+		const uint32_t RESERVED_THREADS = 2;
 
+		#ifdef WINDOWS
 		SYSTEM_INFO systemInfo = {};
 		GetSystemInfo(&systemInfo);
 
+		uint32_t processors = systemInfo.dwNumberOfProcessors;
+		#else
+		// hardware_concurrency may be zero if it isn't known, in which case there is just the one thread
+		uint32_t processors = std::thread::hardware_concurrency();
+		#endif
+
 		// can't use max because this is unsigned
-		maxThreads = systemInfo.dwNumberOfProcessors > RESERVED_THREADS ? systemInfo.dwNumberOfProcessors - RESERVED_THREADS : 1;
+		maxThreads = processors > RESERVED_THREADS ? processors - RESERVED_THREADS : 1;
 	}
 
+	this->maxThreads = maxThreads;
+
+	#ifdef WINDOWS
+	pool = CreateThreadpool(NULL);
+	osErr(pool);
+
 	SetThreadpoolThreadMaximum(pool, maxThreads);
 	osErr(SetThreadpoolThreadMinimum(pool, 1));
+	#else
+	poolOptional.emplace(maxThreads);
+	#endif
 	#endif
 
 	// the number 216 was chosen for being the standard number of tiles in a cube
 	const Work::FileTask::POINTER_QUEUE::size_type DEFAULT_MAX_FILE_TASKS = 216;
 
-	this->maxFileTasks = maxFileTasks ? maxFileTasks : DEFAULT_MAX_FILE_TASKS;
+	tasks.setMaxFileTasks(maxFileTasks ? maxFileTasks : DEFAULT_MAX_FILE_TASKS);
+
+	// half of the minimum system requirement of 1 GB, so there's still room for the rest of the program and the system
+	const size_t DEFAULT_MEMORY_BUDGET = 0x20000000;
+
+	tasks.setMemoryBudget(memoryBudget ? memoryBudget : DEFAULT_MEMORY_BUDGET);
+
+	// enough that the output thread is rarely waiting on a write, without holding on to too many buffers
+	const unsigned int DEFAULT_QUEUE_DEPTH = 4;
+
+	tasks.setQueueDepth(queueDepth ? queueDepth : DEFAULT_QUEUE_DEPTH);
+
+	#ifdef LINUX
+	this->segmentedOutput = segmentedOutput;
+	#endif
 
 	if (configurationOptional.has_value()) {
 		configuration = configurationOptional.value();
@@ -1193,6 +1886,10 @@ void M4Revolution::editTransitionTime() {
 }
 
 void M4Revolution::fixLoading() {
+	#ifdef LINUX
+	segments = 0;
+	#endif
+
 	{
 		std::ifstream inputFileStream;
 		inputFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
@@ -1201,37 +1898,154 @@ void M4Revolution::fixLoading() {
 
 		Ubi::BigFile::File inputFile = createInputFile(inputFileStream);
 
+		// if the file can't be mapped (such as on 32-bit builds) then it is just read through the stream
+		try {
+			inputMappedFileOptional.emplace(Work::Output::DATA_PATH);
+		} catch (std::system_error) {
+			inputMappedFileOptional = std::nullopt;
+		} catch (std::length_error) {
+			inputMappedFileOptional = std::nullopt;
+		}
+
+		SCOPE_EXIT {
+			inputMappedFileOptional = std::nullopt;
+		};
+
 		Log log("Fixing Loading, this may take several minutes", &inputFileStream, inputFile.size, logFileNames, true);
 
+		// the index is created if this file doesn't have one yet, so the next time the directories won't need to be read
+		// (if the file is mapped, the BigFiles are read on many threads at once to create it)
+		// it's only an optimization, so if it fails the directories are read the same as if it were never there
+		try {
+			indexOptional.emplace(
+				inputFileStream,
+				Work::Output::DATA_PATH,
+
+				inputMappedFileOptional.has_value()
+				? &inputMappedFileOptional.value()
+				: 0,
+
+				true,
+				maxThreads
+			);
+		} catch (std::system_error) {
+			indexOptional = std::nullopt;
+		} catch (std::invalid_argument) {
+			indexOptional = std::nullopt;
+		}
+
+		SCOPE_EXIT {
+			indexOptional = std::nullopt;
+		};
+
+		// if fixing loading was interrupted before, the journal says how far it got, so it can carry on from there
+		// if it can't be kept, then it just starts from the beginning every time, same as if there were no journal
+		try {
+			journalOptional.emplace(inputFileStream, Work::Output::DATA_PATH);
+		} catch (std::system_error) {
+			journalOptional = std::nullopt;
+		} catch (std::invalid_argument) {
+			journalOptional = std::nullopt;
+		}
+
+		#ifdef LINUX
+		// the journal only knows how far the top BigFile got, so it can't be used with segmented output
+		// (any journal from before is removed too, because the output it goes with will be overwritten)
+		if (segmentedOutput) {
+			journalOptional = std::nullopt;
+			Work::Journal::remove();
+		}
+		#endif
+
+		SCOPE_EXIT {
+			journalOptional = std::nullopt;
+		};
+
+		// files that were converted before, the same way, don't need to be converted again
+		// it's only an optimization, so if the cache can't be created, every file is converted
+		if (cacheConvertedFiles) {
+			try {
+				cacheOptional.emplace(Work::Cache::getPath(Work::Output::DATA_PATH));
+			} catch (std::system_error) {
+				cacheOptional = std::nullopt;
+			}
+		}
+
+		SCOPE_EXIT {
+			cacheOptional = std::nullopt;
+		};
+
+		// the results are only kept for duplicates found while fixing loading
+		SCOPE_EXIT {
+			resultPointerMap.clear();
+		};
+
+		if (journalOptional.has_value() && journalOptional.value().getCheckpointOptional().has_value()) {
+			consoleLog("Fixing Loading was interrupted before, so it will carry on from where it left off.", 2);
+		}
+
 		// to avoid a sharing violation this must happen first before creating the output thread
 		// as they will both write to the same temporary file
 		#ifdef WINDOWS
 		OPERATION_EXCEPTION_RETRY_ERR(replaceGfxTools(), std::system_error, Work::Output::FILE_RETRY);
 		#endif
 
-		bool yield = true;
-		std::thread outputThread(M4Revolution::outputThread, std::ref(tasks), std::ref(yield));
+		// the slabs are only kept to be used again while fixing loading, whether or not it fails
+		// (this is declared first, so it happens after the output thread is joined)
+		SCOPE_EXIT {
+			Work::Data::releaseSlabs();
+		};
+
+		Work::Segment &segment = tasks.getSegment();
+		segment.yield = true;
+
+		std::thread outputThread(
+			M4Revolution::outputThread,
+			std::ref(tasks),
+			std::ref(segment),
+
+			journalOptional.has_value()
+			? &journalOptional.value()
+			: 0
+		);
+
+		// if fixing loading fails, the output thread still writes whatever was queued, so that it can be joined
+		MAKE_SCOPE_EXIT(outputThreadScopeExit) {
+			endSegment(segment, inputFile);
+			outputThread.join();
+
+			// without a journal, nothing will carry on from the output file, so it isn't kept
+			if (!journalOptional.has_value()) {
+				std::error_code errorCode = {};
+				std::filesystem::remove(Work::Journal::OUTPUT_FILE_NAME, errorCode);
+			}
+		};
+
+		const std::string ABORTED_RESTORE_BACKUP = journalOptional.has_value()
+			? " Fixing Loading again will carry on from where it left off, or it is recommended you restore the backup to revert the changes."
+			: " It is recommended you restore the backup to revert the changes.";
 
 		try {
 			fixLoading(inputFileStream, 0, inputFile, log);
 		} catch (std::system_error) {
-			throw Aborted("Fixing Loading failed due to a system error. It is recommended you restore the backup to revert the changes.");
+			throw Aborted(("Fixing Loading failed due to a system error." + ABORTED_RESTORE_BACKUP).c_str());
 		} catch (std::invalid_argument) {
-			throw Aborted("Fixing Loading failed due to an invalid argument. It is recommended you restore the backup to revert the changes.");
+			throw Aborted(("Fixing Loading failed due to an invalid argument." + ABORTED_RESTORE_BACKUP).c_str());
 		}
 
-		log.finishing();
+		outputThreadScopeExit.dismiss();
 
-		// necessary to wake up the output thread one last time at the end
-		Work::FileTask::POINTER fileTaskPointer = std::make_shared<Work::FileTask>(-1, &inputFile);
-		fileTaskPointer->complete();
-		tasks.fileLock().get().push(fileTaskPointer);
+		log.finishing();
 
-		yield = false;
+		endSegment(segment, inputFile);
 		outputThread.join();
 	}
 
-	Work::Backup::create(Work::Output::DATA_PATH.string().c_str());
+	Work::Backup::create(Work::Output::DATA_PATH.string().c_str(), Work::Journal::OUTPUT_FILE_NAME);
+
+	// the index and journal were for the file that was just replaced
+	Work::Index::remove(Work::Output::DATA_PATH);
+	Work::Journal::remove();
 }
 
 void M4Revolution::restoreBackup() {
@@ -1268,4 +2082,10 @@ void M4Revolution::restoreBackup() {
 			Work::Backup::restore(infoMapIterator->second.path);
 		}
 	}
+
+	// anything left over from fixing loading being interrupted is for the changes that were just reverted
+	Work::Journal::remove();
+
+	// the cache isn't needed once the converted files are gone, and it takes up about as much space as they did
+	Work::Cache::remove(Work::Output::DATA_PATH);
 }
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include "shared.h"
 #include "Ubi.h"
 #include "Work.h"
+#include "MappedFile.h"
 #include <nvtt/nvtt.h>
 
 #ifdef WINDOWS
@@ -11,6 +12,9 @@
 	#define TO_NEXT_POWER_OF_TWO
 #endif
 
+// predict the size of converted files, so the output thread can move on without waiting for them to be converted
+#define PLANNED_LAYOUT
+
 class M4Revolution {
 	private:
 	void destroy();
@@ -48,17 +52,29 @@ class M4Revolution {
 		public:
 		CompressionOptions();
 		const nvtt::CompressionOptions &get(const Ubi::BigFile::File &file, const nvtt::Surface &surface, bool hasAlpha) const;
+		bool isBlockCompressed(const nvtt::CompressionOptions &compressionOptions) const;
 	};
 
 	struct OutputHandler : public nvtt::OutputHandler {
-		OutputHandler(Work::FileTask &fileTask);
+		OutputHandler(Work::FileTask &fileTask, Work::Gate &memoryGate);
 		OutputHandler(const OutputHandler &outputHandler) = delete;
 		OutputHandler &operator=(const OutputHandler &outputHandler) = delete;
 		virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel);
 		virtual void endImage();
 		virtual bool writeData(const void* data, int size);
+		void flush();
 
 		Work::FileTask &fileTask;
+		Work::Gate &memoryGate;
+
+		// if the file is being added to the cache, or might have duplicates, everything written is also kept for them
+		Work::Cache::Entry* cacheEntryPointer = 0;
+		std::string* resultDataPointer = 0;
+
+		// the data is written into slabs, which are only handed to the output thread once they're full (or flushed)
+		Work::Data::POINTER slabPointer = 0;
+		size_t slabSize = 0;
+		size_t flushedSize = 0;
 
 		unsigned int size = 0;
 	};
@@ -71,17 +87,41 @@ class M4Revolution {
 
 	bool logFileNames = false;
 
+	// the cache keeps a copy of every converted file on disk, so it's only used if asked for
+	bool cacheConvertedFiles = false;
+
+	// the most threads to use at once, for converting and for reading the BigFiles to create the index
+	uint32_t maxThreads = 1;
+
+	#ifdef LINUX
+	bool segmentedOutput = false;
+
+	// the segment the reading thread is queueing FileTasks in, if it's not the top one
+	Work::Segment::POINTER segmentPointer = 0;
+	unsigned int segments = 0;
+	#endif
+
 	nvtt::Context context = {};
 
 	#ifdef MULTITHREADED
+	#ifdef WINDOWS
 	PTP_POOL pool = NULL;
+	#else
+	std::optional<Work::Pool> poolOptional = std::nullopt;
+	#endif
 	#endif
 
-	Work::FileTask::POINTER_QUEUE::size_type maxFileTasks = 0;
 	Work::Convert::Configuration configuration;
 	Work::Tasks tasks = {};
 
-	void waitFiles(Work::FileTask::POINTER_QUEUE::size_type fileTasks);
+	// the input file is mapped while fixing loading, so directories can be parsed without any system calls
+	std::optional<MappedFile> inputMappedFileOptional = std::nullopt;
+	std::optional<Work::Index> indexOptional = std::nullopt;
+	std::optional<Work::Journal> journalOptional = std::nullopt;
+	std::optional<Work::Cache> cacheOptional = std::nullopt;
+
+	// only used by the thread reading the files, which is the one that finds duplicates
+	Work::Result::POINTER_MAP resultPointerMap = {};
 
 	void copyFiles(
 		std::istream &inputStream,
@@ -89,12 +129,13 @@ class M4Revolution {
 		Ubi::BigFile::File::SIZE inputCopyPosition,
 		Ubi::BigFile::File::POINTER_VECTOR_POINTER &filePointerVectorPointer,
 		std::streampos bigFileInputPosition,
+		const Work::BigFileTask::POINTER &bigFileTaskPointer,
 		Log &log
 	);
 
 	void convertFile(
 		std::istream &inputStream,
-		std::streampos ownerBigFileInputPosition,
+		const Work::BigFileTask::POINTER &ownerBigFileTaskPointer,
 		Ubi::BigFile::File &file,
 		Work::Convert::FileWorkCallback fileWorkCallback
 	);
@@ -102,10 +143,13 @@ class M4Revolution {
 	void convertFile(
 		std::istream &inputStream,
 		std::streampos bigFileInputPosition,
+		const Work::BigFileTask::POINTER &bigFileTaskPointer,
 		Ubi::BigFile::File &file,
 		Log &log
 	);
 
+	void stopFile(Work::FileTask &fileTask);
+
 	void stepFile(
 		Ubi::BigFile::File::SIZE inputPosition,
 		Ubi::BigFile::File::SIZE &inputFilePosition,
@@ -114,7 +158,14 @@ class M4Revolution {
 		Log &log
 	);
 
-	void fixLoading(std::istream &inputStream, std::streampos ownerBigFileInputPosition, Ubi::BigFile::File &file, Log &log);
+	void fixLoading(std::istream &inputStream, const Work::BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File &file, Log &log);
+
+	#ifdef LINUX
+	void fixLoadingSegment(std::istream &inputStream, const Work::BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File &file, Log &log);
+	#endif
+
+	Work::FileTask::POINTER_QUEUE_LOCK fileLock();
+	void endSegment(Work::Segment &segment, Ubi::BigFile::File &file);
 
 	static const Ubi::BigFile::Path::VECTOR TRANSITION_FADE_PATH_VECTOR;
 	static const CompressionOptions COMPRESSION_OPTIONS;
@@ -127,16 +178,33 @@ class M4Revolution {
 	static void replaceGfxTools();
 	#endif
 	static Ubi::BigFile::File createInputFile(std::istream &inputStream);
+	static size_t getSurfaceSize(const nvtt::Surface &surface);
+	static std::string getKey(const Work::Convert &convert);
+	static void writeResult(const std::string &data, Work::FileTask &fileTask, Ubi::BigFile::File &file, Work::Gate &memoryGate);
+	static void completeResult(Work::Convert &convert, const Work::Result::DATA_POINTER &dataPointer);
+	static bool readCache(Work::Convert &convert);
 	static void convertSurface(Work::Convert &convert, nvtt::Surface &surface, bool hasAlpha);
 	static void convertImageStandardWorkCallback(Work::Convert* convertPointer);
 	static void convertImageZAPWorkCallback(Work::Convert* convertPointer);
 	#ifdef MULTITHREADED
+	#ifdef WINDOWS
 	static VOID CALLBACK convertFileProc(PTP_CALLBACK_INSTANCE instance, PVOID parameter, PTP_WORK work);
+	#else
+	static void convertFileProc(void* parameter);
+	#endif
+	#endif
+	static void enterBigFiles(Work::Writer &writer, Work::BigFileTask &bigFileTask);
+	static void outputBigFiles(Work::Writer &writer, Work::BigFileTask::POINTER bigFileTaskPointer, bool end);
+	static bool takeFiles(Work::FileTask::POINTER_QUEUE &fileTaskPointerQueue, Work::Reorder &reorder, Work::Writer &writer, Work::Segment &segment);
+	static void outputData(Work::Output &output, Work::FileTask::POINTER_QUEUE &fileTaskPointerQueue, Work::Reorder &reorder, Work::Tasks &tasks, Work::Segment &segment);
+	static void outputFiles(Work::BigFileTask &bigFileTask, Work::FileTask::FILE_VARIANT &fileVariant);
+	#ifdef PLANNED_LAYOUT
+	static void outputPlaced(Work::Writer &writer, Work::Reorder &reorder, Work::Signal &outputSignal);
+	#endif
+	#ifdef LINUX
+	static void outputSegment(Work::Writer &writer, Work::Reorder &reorder, Work::Signal &outputSignal, Work::BigFileTask &bigFileTask, Work::Segment &segment, Ubi::BigFile::File &file);
 	#endif
-	static bool outputBigFiles(Work::Output &output, std::streampos bigFileInputPosition, Work::Tasks &tasks);
-	static void outputData(std::ostream &outputStream, Work::FileTask &fileTask, bool &yield);
-	static void outputFiles(Work::Output &output, Work::FileTask::FILE_VARIANT &fileVariant);
-	static void outputThread(Work::Tasks &tasks, bool &yield);
+	static void outputThread(Work::Tasks &tasks, Work::Segment &segment, Work::Journal* journalPointer);
 	#ifdef WINDOWS
 	static bool getDLLExportRVA(const char* libFileName, const char* procName, unsigned long &dllExportRVA);
 	#endif
@@ -152,8 +220,12 @@ class M4Revolution {
 		const std::filesystem::path &path,
 		bool logFileNames = false,
 		bool disableHardwareAcceleration = false,
+		bool cacheConvertedFiles = false,
 		uint32_t maxThreads = 0,
 		Work::FileTask::POINTER_QUEUE::size_type maxFileTasks = 0,
+		size_t memoryBudget = 0,
+		unsigned int queueDepth = 0,
+		bool segmentedOutput = false,
 		std::optional<Work::Convert::Configuration> configurationOptional = std::nullopt
 	);
 	
@@ -0,0 +1,103 @@
+#include "MappedFile.h"
+
+#ifdef MACINTOSH
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+void MappedFile::destroy() {
+	#ifdef MACINTOSH
+	if (data) {
+		munmap((void*)data, size);
+	}
+
+	if (fileDescriptor != -1) {
+		close(fileDescriptor);
+	}
+
+	fileDescriptor = -1;
+	#endif
+	#ifdef WINDOWS
+	if (data) {
+		UnmapViewOfFile(data);
+	}
+
+	closeHandle(fileMapping);
+	closeHandle(file);
+	#endif
+
+	data = 0;
+	size = 0;
+}
+
+MappedFile::MappedFile(const std::filesystem::path &path) {
+	MAKE_SCOPE_EXIT(destroyScopeExit) {
+		destroy();
+	};
+
+	#ifdef MACINTOSH
+	fileDescriptor = open(path.c_str(), O_RDONLY);
+
+	if (fileDescriptor == -1) {
+		throw std::system_error(errno, std::generic_category());
+	}
+
+	struct stat fileStat = {};
+
+	if (fstat(fileDescriptor, &fileStat) == -1) {
+		throw std::system_error(errno, std::generic_category());
+	}
+
+	size = (size_t)fileStat.st_size;
+
+	// mapping an empty file is an error, but there is nothing to read anyway
+	if (size) {
+		void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+
+		if (mapping == MAP_FAILED) {
+			throw std::system_error(errno, std::generic_category());
+		}
+
+		data = (const unsigned char*)mapping;
+	}
+	#endif
+	#ifdef WINDOWS
+	file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	osErr(file);
+
+	LARGE_INTEGER fileSize = {};
+	osErr(GetFileSizeEx(file, &fileSize));
+
+	// this will only fail on 32-bit builds, where large files cannot be mapped all at once
+	if ((ULONGLONG)fileSize.QuadPart > (ULONGLONG)SIZE_MAX) {
+		throw std::length_error("fileSize must not be greater than SIZE_MAX");
+	}
+
+	size = (size_t)fileSize.QuadPart;
+
+	// mapping an empty file is an error, but there is nothing to read anyway
+	if (size) {
+		fileMapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		osErr(fileMapping);
+
+		data = (const unsigned char*)MapViewOfFile(fileMapping, FILE_MAP_READ, 0, 0, 0);
+		osErr(data != NULL);
+	}
+	#endif
+
+	destroyScopeExit.dismiss();
+}
+
+MappedFile::~MappedFile() {
+	destroy();
+}
+
+const unsigned char* MappedFile::getData() const {
+	return data;
+}
+
+size_t MappedFile::getSize() const {
+	return size;
+}
\ No newline at end of file
@@ -0,0 +1,29 @@
+#pragma once
+#include "shared.h"
+#include <filesystem>
+
+// maps a file into memory (read only) so that it may be parsed directly instead of through a stream
+// the file is shared for reading, so this may be used alongside an input stream that denies writing
+class MappedFile {
+	private:
+	void destroy();
+
+	#ifdef MACINTOSH
+	int fileDescriptor = -1;
+	#endif
+	#ifdef WINDOWS
+	HANDLE file = INVALID_HANDLE_VALUE;
+	HANDLE fileMapping = NULL;
+	#endif
+
+	const unsigned char* data = 0;
+	size_t size = 0;
+
+	public:
+	MappedFile(const std::filesystem::path &path);
+	~MappedFile();
+	MappedFile(const MappedFile &mappedFile) = delete;
+	MappedFile &operator=(const MappedFile &mappedFile) = delete;
+	const unsigned char* getData() const;
+	size_t getSize() const;
+};
\ No newline at end of file
@@ -1,24 +1,188 @@
 #include "Ubi.h"
 #include <regex>
+#include <mango/simd/simd.hpp>
+#include <algorithm>
 
 namespace Ubi {
+	// so the same code may read from either a stream or a span
+	static void readBuffer(std::istream &inputStream, void* buffer, size_t count) {
+		readStream(inputStream, buffer, count);
+	}
+
+	static void readBuffer(SpanReader &spanReader, void* buffer, size_t count) {
+		spanReader.read(buffer, count);
+	}
+
+	// names are always copied into the string table, because the span may not last as long as the BigFile
+	static std::optional<std::string_view> readName(std::istream &inputStream, BigFile::StringTable &stringTable) {
+		String::SIZE size = 0;
+		readStream(inputStream, &size, String::SIZE_SIZE);
+
+		if (!size) {
+			return std::nullopt;
+		}
+		return stringTable.add(inputStream, size);
+	}
+
+	static std::optional<std::string_view> readName(SpanReader &spanReader, BigFile::StringTable &stringTable) {
+		std::optional<std::string_view> nameOptional = String::readOptionalView(spanReader);
+
+		if (!nameOptional.has_value()) {
+			return std::nullopt;
+		}
+		return stringTable.add(nameOptional.value());
+	}
+
+	// for index records, where the indices are in a vector but must be written the same size on every platform
+	static void writeIndexSize(std::ostream &outputStream, size_t index) {
+		BigFile::INDEX_SIZE indexSize = (BigFile::INDEX_SIZE)index;
+		writeStream(outputStream, &indexSize, BigFile::INDEX_SIZE_SIZE);
+	}
+
+	static size_t readIndexSize(SpanReader &indexReader) {
+		BigFile::INDEX_SIZE indexSize = 0;
+		indexReader.read(&indexSize, BigFile::INDEX_SIZE_SIZE);
+		return indexSize;
+	}
+
+	SpanReader::StreamBuffer::pos_type SpanReader::StreamBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) {
+		const pos_type INVALID = pos_type(off_type(-1));
+
+		if (!(which & std::ios_base::in)) {
+			return INVALID;
+		}
+
+		off_type position = 0;
+
+		switch (dir) {
+			case std::ios_base::beg:
+			position = off;
+			break;
+			case std::ios_base::cur:
+			position = (off_type)(gptr() - eback()) + off;
+			break;
+			case std::ios_base::end:
+			position = (off_type)(egptr() - eback()) + off;
+			break;
+			default:
+			return INVALID;
+		}
+
+		if (position < 0 || position > (off_type)(egptr() - eback())) {
+			return INVALID;
+		}
+
+		setg(eback(), eback() + position, egptr());
+		return pos_type(position);
+	}
+
+	SpanReader::StreamBuffer::pos_type SpanReader::StreamBuffer::seekpos(pos_type pos, std::ios_base::openmode which) {
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+
+	SpanReader::StreamBuffer::StreamBuffer(const SpanReader &spanReader) {
+		// the get area is never written to, the cast is only because streambuf wants it
+		char* data = (char*)spanReader.data;
+		setg(data, data + spanReader.position, data + spanReader.size);
+	}
+
+	SpanReader::SpanReader(const unsigned char* data, size_t size, size_t position)
+		: data(data),
+		size(size) {
+		seek(position);
+	}
+
+	void SpanReader::read(void* buffer, size_t count) {
+		if (!count) {
+			return;
+		}
+
+		if (memcpy_s(buffer, count, view(count), count)) {
+			throw std::runtime_error("Failed to Copy Memory");
+		}
+	}
+
+	const unsigned char* SpanReader::view(size_t count) {
+		if (count > size - position) {
+			throw ReadPastEnd();
+		}
+
+		const unsigned char* viewPointer = data + position;
+		position += count;
+		return viewPointer;
+	}
+
+	void SpanReader::seek(size_t position) {
+		if (position > size) {
+			throw ReadPastEnd();
+		}
+
+		this->position = position;
+	}
+
+	void SpanReader::skip(size_t count) {
+		view(count);
+	}
+
+	size_t SpanReader::tell() const {
+		return position;
+	}
+
+	const unsigned char* SpanReader::getData() const {
+		return data;
+	}
+
+	size_t SpanReader::getSize() const {
+		return size;
+	}
+
 	namespace String {
-		std::optional<std::string> &swizzle(std::optional<std::string> &encryptedStringOptional) {
-			if (!encryptedStringOptional.has_value()) {
-				return encryptedStringOptional;
+		void swizzle(char* str, size_t size) {
+			// the encryption swaps every pair of bits in each character
+			// no bits move between characters, so many of them may be done at once
+			const size_t VECTOR_SIZE = sizeof(mango::simd::u16x8);
+
+			const mango::simd::u16x8 MASK_EVEN = mango::simd::u16x8_set(0x5555);
+			const mango::simd::u16x8 MASK_ODD = mango::simd::u16x8_set(0xAAAA);
+
+			mango::simd::u16x8 block = {};
+
+			while (size >= VECTOR_SIZE) {
+				block = mango::simd::u16x8_uload(str);
+
+				// the bits shifted across the characters are masked out
+				block = mango::simd::bitwise_or(
+					mango::simd::bitwise_and(mango::simd::srli<1>(block), MASK_EVEN),
+					mango::simd::bitwise_and(mango::simd::slli<1>(block), MASK_ODD)
+				);
+
+				mango::simd::u16x8_ustore(str, block);
+
+				str += VECTOR_SIZE;
+				size -= VECTOR_SIZE;
 			}
 
 			const char MASK = 85;
 
-			std::string &encryptedString = encryptedStringOptional.value();
+			char encryptedCharLeft = 0;
+			char encryptedCharRight = 0;
 
-			for (std::string::iterator encryptedStringIterator = encryptedString.begin(); encryptedStringIterator != encryptedString.end(); encryptedStringIterator++) {
-				char &encryptedChar = *encryptedStringIterator;
-				char encryptedCharLeft = encryptedChar << 1;
-				char encryptedCharRight = encryptedChar >> 1;
+			for (char* strEnd = str + size; str != strEnd; str++) {
+				char &encryptedChar = *str;
+				encryptedCharLeft = encryptedChar << 1;
+				encryptedCharRight = encryptedChar >> 1;
 
 				encryptedChar = (encryptedCharLeft ^ encryptedCharRight) & MASK ^ encryptedCharLeft;
 			}
+		}
+
+		std::optional<std::string> &swizzle(std::optional<std::string> &encryptedStringOptional) {
+			if (!encryptedStringOptional.has_value()) {
+				return encryptedStringOptional;
+			}
+
+			std::string &encryptedString = encryptedStringOptional.value();
+			swizzle(encryptedString.data(), encryptedString.size());
 			return encryptedStringOptional;
 		}
 
@@ -49,12 +213,87 @@ namespace Ubi {
 			return readOptional(inputStream, nullTerminator);
 		}
 
+		std::optional<std::string_view> readOptionalView(SpanReader &spanReader, bool &nullTerminator) {
+			MAKE_SCOPE_EXIT(nullTerminatorScopeExit) {
+				nullTerminator = true;
+			};
+
+			SIZE size = 0;
+			spanReader.read(&size, SIZE_SIZE);
+
+			if (!size) {
+				return std::nullopt;
+			}
+
+			// the view points into the span, so it must not outlive it
+			const char* str = (const char*)spanReader.view(size);
+
+			nullTerminator = !str[size - 1];
+			nullTerminatorScopeExit.dismiss();
+
+			// same as the stream version, which stops at the first null character
+			return std::string_view(str, strnlen(str, size));
+		}
+
+		std::optional<std::string_view> readOptionalView(SpanReader &spanReader) {
+			bool nullTerminator = true;
+			return readOptionalView(spanReader, nullTerminator);
+		}
+
 		std::optional<std::string> readOptionalEncrypted(std::istream &inputStream) {
 			std::optional<std::string> encryptedStringOptional = readOptional(inputStream);
 			return swizzle(encryptedStringOptional);
 		}
 
-		void writeOptional(std::ostream &outputStream, const std::optional<std::string> &strOptional, bool nullTerminator) {
+		void readOptionalEncrypted(std::istream &inputStream, uint32_t count, OPTIONAL_VECTOR &encryptedStringOptionalVector) {
+			// the strings are read one after another into the same buffer, so they are all decrypted at once
+			// then they are split back up (where like readOptional, each one ends at the first null character)
+			typedef std::vector<SIZE> SIZE_VECTOR;
+
+			// count isn't reserved, as it comes from the file and may not be trustworthy
+			SIZE_VECTOR sizeVector = {};
+
+			std::string encryptedStrings = "";
+			SIZE size = 0;
+
+			for (uint32_t i = 0; i < count; i++) {
+				readStream(inputStream, &size, SIZE_SIZE);
+				sizeVector.push_back(size);
+
+				if (!size) {
+					continue;
+				}
+
+				std::string::size_type encryptedStringsSize = encryptedStrings.size();
+				encryptedStrings.resize(encryptedStringsSize + size);
+				readStream(inputStream, encryptedStrings.data() + encryptedStringsSize, size);
+			}
+
+			swizzle(encryptedStrings.data(), encryptedStrings.size());
+
+			encryptedStringOptionalVector.clear();
+			encryptedStringOptionalVector.reserve(sizeVector.size());
+
+			const char* str = encryptedStrings.data();
+
+			for (
+				SIZE_VECTOR::const_iterator sizeVectorIterator = sizeVector.begin();
+				sizeVectorIterator != sizeVector.end();
+				sizeVectorIterator++
+			) {
+				size = *sizeVectorIterator;
+
+				if (!size) {
+					encryptedStringOptionalVector.push_back(std::nullopt);
+					continue;
+				}
+
+				encryptedStringOptionalVector.push_back(std::string(str, strnlen(str, size)));
+				str += size;
+			}
+		}
+
+		void writeOptional(std::ostream &outputStream, const std::optional<std::string_view> &strOptional, bool nullTerminator) {
 			SIZE size = strOptional.has_value() ? (SIZE)(strOptional.value().size() + nullTerminator) : 0;
 			writeStream(outputStream, &size, SIZE_SIZE);
 
@@ -62,7 +301,14 @@ namespace Ubi {
 				return;
 			}
 
-			writeStream(outputStream, strOptional.value().c_str(), size);
+			// string views aren't null terminated, so the null terminator is written seperately
+			const std::string_view &STR = strOptional.value();
+			writeStream(outputStream, STR.data(), STR.size());
+
+			if (nullTerminator) {
+				const char NULL_TERMINATOR = 0;
+				writeStream(outputStream, &NULL_TERMINATOR, sizeof(NULL_TERMINATOR));
+			}
 		}
 
 		void writeOptionalEncrypted(std::ostream &outputStream, std::optional<std::string> &strOptional) {
@@ -199,13 +445,22 @@ namespace Ubi {
 
 			readStream(inputStream, &sets, SETS_SIZE);
 
-			std::optional<std::string> setOptional = std::nullopt;
+			String::OPTIONAL_VECTOR setOptionalVector = {};
+			String::readOptionalEncrypted(inputStream, sets, setOptionalVector);
+
+			if (layerFileOptional.has_value()) {
+				RLE::SETS_SET &setsSet = layerMapIterator->second.setsSet;
 
-			for (uint32_t i = 0; i < sets; i++) {
-				setOptional = String::readOptionalEncrypted(inputStream);
+				for (
+					String::OPTIONAL_VECTOR::const_iterator setOptionalVectorIterator = setOptionalVector.begin();
+					setOptionalVectorIterator != setOptionalVector.end();
+					setOptionalVectorIterator++
+				) {
+					const std::optional<std::string> &SET_OPTIONAL = *setOptionalVectorIterator;
 
-				if (setOptional.has_value() && layerFileOptional.has_value()) {
-					layerMapIterator->second.setsSet.insert(setOptional.value());
+					if (SET_OPTIONAL.has_value()) {
+						setsSet.insert(SET_OPTIONAL.value());
+					}
 				}
 			}
 
@@ -546,26 +801,134 @@ namespace Ubi {
 		return *this;
 	}
 
-	BigFile::File::File(std::istream &inputStream, SIZE &fileSystemSize, const std::optional<File> &layerFileOptional) {
-		read(inputStream);
-		rename(layerFileOptional);
+	BigFile::StringTable::StringTable() {
+	}
 
-		fileSystemSize += (SIZE)(
-			String::SIZE_SIZE
+	char* BigFile::StringTable::allocate(size_t size) {
+		if (size > freeSize) {
+			// the blocks start out small, as most BigFiles only have a few names in them
+			blockSize = blockSize ? blockSize * 2 : BLOCK_SIZE_MIN;
 
-			+ (
-				nameOptional.has_value()
-				? nameOptional.value().size() + 1
-				: 0
-			)
+			if (blockSize > BLOCK_SIZE_MAX) {
+				blockSize = BLOCK_SIZE_MAX;
+			}
 
-			+ SIZE_SIZE
-			+ POSITION_SIZE
-		);
+			freeSize = size > blockSize ? size : blockSize;
+
+			blockPointerVector.push_back(BLOCK_POINTER(new char[freeSize]));
+			freePointer = blockPointerVector.back().get();
+		}
+
+		char* str = freePointer;
+		freePointer += size;
+		freeSize -= size;
+		return str;
 	}
 
-	BigFile::File::File(std::istream &inputStream) {
-		read(inputStream);
+	void BigFile::StringTable::deallocate(char* tableStr, size_t size) {
+		// only the last string allocated may be deallocated, by giving its space back to the current block
+		if (tableStr + size != freePointer) {
+			throw std::logic_error("tableStr must be the last string allocated");
+		}
+
+		freePointer = tableStr;
+		freeSize += size;
+	}
+
+	std::string_view BigFile::StringTable::intern(char* tableStr, size_t size, std::string_view str) {
+		// str was just allocated in the table, and if it's already there the new copy is freed
+		STR_SET::iterator strSetIterator = strSet.find(str);
+
+		if (strSetIterator != strSet.end()) {
+			deallocate(tableStr, size);
+			return *strSetIterator;
+		}
+
+		strSet.insert(str);
+		return str;
+	}
+
+	std::string_view BigFile::StringTable::add(std::string_view str) {
+		// looked up first, so it isn't copied at all if it's already there
+		STR_SET::iterator strSetIterator = strSet.find(str);
+
+		if (strSetIterator != strSet.end()) {
+			return *strSetIterator;
+		}
+
+		char* tableStr = allocate(str.size());
+
+		if (str.size()) {
+			if (memcpy_s(tableStr, str.size(), str.data(), str.size())) {
+				throw std::runtime_error("Failed to Copy String");
+			}
+		}
+
+		std::string_view tableStrView(tableStr, str.size());
+		strSet.insert(tableStrView);
+		return tableStrView;
+	}
+
+	std::string_view BigFile::StringTable::add(std::initializer_list<std::string_view> strInitializerList) {
+		size_t size = 0;
+
+		for (
+			std::initializer_list<std::string_view>::iterator strInitializerListIterator = strInitializerList.begin();
+			strInitializerListIterator != strInitializerList.end();
+			strInitializerListIterator++
+		) {
+			size += strInitializerListIterator->size();
+		}
+
+		// the strings are put together in the table, instead of in a temporary string to look up
+		char* tableStr = allocate(size);
+		char* currentTableStr = tableStr;
+		size_t currentSize = size;
+
+		for (
+			std::initializer_list<std::string_view>::iterator strInitializerListIterator = strInitializerList.begin();
+			strInitializerListIterator != strInitializerList.end();
+			strInitializerListIterator++
+		) {
+			const std::string_view &STR = *strInitializerListIterator;
+
+			if (STR.size()) {
+				if (memcpy_s(currentTableStr, currentSize, STR.data(), STR.size())) {
+					throw std::runtime_error("Failed to Copy String");
+				}
+			}
+
+			currentTableStr += STR.size();
+			currentSize -= STR.size();
+		}
+		return intern(tableStr, size, std::string_view(tableStr, size));
+	}
+
+	std::string_view BigFile::StringTable::add(std::istream &inputStream, size_t size) {
+		// the string is read straight into the table, where like String::readOptional, it ends at the first null character
+		char* tableStr = allocate(size);
+
+		MAKE_SCOPE_EXIT(deallocateScopeExit) {
+			deallocate(tableStr, size);
+		};
+
+		readStream(inputStream, tableStr, size);
+		deallocateScopeExit.dismiss();
+		return intern(tableStr, size, std::string_view(tableStr, strnlen(tableStr, size)));
+	}
+
+	BigFile::File::File(std::istream &inputStream, StringTable &stringTable, SIZE &fileSystemSize, const std::optional<File> &layerFileOptional) {
+		read(inputStream, stringTable);
+		create(stringTable, fileSystemSize, layerFileOptional);
+	}
+
+	BigFile::File::File(SpanReader &spanReader, StringTable &stringTable, SIZE &fileSystemSize, const std::optional<File> &layerFileOptional) {
+		read(spanReader, stringTable);
+		create(stringTable, fileSystemSize, layerFileOptional);
+	}
+
+	BigFile::File::File(SpanReader &indexReader, StringTable &stringTable) {
+		readIndex(indexReader, stringTable);
 	}
 
 	BigFile::File::File(SIZE inputFileSize) : size(inputFileSize) {
@@ -577,6 +940,18 @@ namespace Ubi {
 		writeStream(outputStream, &position, POSITION_SIZE);
 	}
 
+	void BigFile::File::writeIndex(std::ostream &outputStream) const {
+		// the name is the one after renaming, and the type and rgba are
+		// already decided, so the layer information doesn't need to be kept
+		write(outputStream);
+
+		uint8_t typeIndex = (uint8_t)type;
+		writeStream(outputStream, &typeIndex, sizeof(typeIndex));
+
+		uint8_t rgbaIndex = rgba;
+		writeStream(outputStream, &rgbaIndex, sizeof(rgbaIndex));
+	}
+
 	Binary::Resource::POINTER BigFile::File::appendToLayerMap(
 		std::istream &inputStream,
 		SIZE fileSystemPosition,
@@ -615,13 +990,53 @@ namespace Ubi {
 		return resourcePointer;
 	}
 
-	void BigFile::File::read(std::istream &inputStream) {
-		nameOptional = String::readOptional(inputStream);
+	void BigFile::File::create(StringTable &stringTable, SIZE &fileSystemSize, const std::optional<File> &layerFileOptional) {
+		rename(stringTable, layerFileOptional);
+
+		fileSystemSize += (SIZE)(
+			String::SIZE_SIZE
+
+			+ (
+				nameOptional.has_value()
+				? nameOptional.value().size() + 1
+				: 0
+			)
+
+			+ SIZE_SIZE
+			+ POSITION_SIZE
+		);
+	}
+
+	void BigFile::File::read(std::istream &inputStream, StringTable &stringTable) {
+		nameOptional = readName(inputStream, stringTable);
 		readStream(inputStream, &size, SIZE_SIZE);
 		readStream(inputStream, &position, POSITION_SIZE);
 	}
 
-	void BigFile::File::rename(const std::optional<File> &layerFileOptional) {
+	void BigFile::File::read(SpanReader &spanReader, StringTable &stringTable) {
+		nameOptional = readName(spanReader, stringTable);
+		spanReader.read(&size, SIZE_SIZE);
+		spanReader.read(&position, POSITION_SIZE);
+	}
+
+	void BigFile::File::readIndex(SpanReader &indexReader, StringTable &stringTable) {
+		read(indexReader, stringTable);
+
+		uint8_t typeIndex = 0;
+		indexReader.read(&typeIndex, sizeof(typeIndex));
+
+		if (typeIndex > (uint8_t)TYPE::IMAGE_ZAP) {
+			throw Invalid();
+		}
+
+		type = (TYPE)typeIndex;
+
+		uint8_t rgbaIndex = 0;
+		indexReader.read(&rgbaIndex, sizeof(rgbaIndex));
+		rgba = rgbaIndex;
+	}
+
+	void BigFile::File::rename(StringTable &stringTable, const std::optional<File> &layerFileOptional) {
 		#ifdef RENAME_ENABLED
 		// predetermines what the new name will be after conversion
 		// this is necessary so we will know the position of the files before writing them
@@ -629,7 +1044,7 @@ namespace Ubi {
 			return;
 		}
 
-		const std::string &NAME = nameOptional.value();
+		const std::string_view NAME = nameOptional.value();
 
 		// note that these are case insensitive, because Myst 4 also uses case insensitive name extensions
 		TYPE_EXTENSION_MAP::const_iterator nameTypeExtensionMapIterator = NAME_TYPE_EXTENSION_MAP.find(getNameExtension(NAME));
@@ -648,7 +1063,7 @@ namespace Ubi {
 				return;
 			}
 
-			const Binary::RLE::Layer &LAYER = layerFileOptional.value().layerMapIterator->second;
+			const Binary::RLE::Layer &LAYER = *layerFileOptional.value().layerPointer;
 
 			if (LAYER.isLayerMask) {
 				#ifdef GREYSCALE_ENABLED
@@ -660,7 +1075,7 @@ namespace Ubi {
 			}
 
 			#ifdef RGBA_ENABLED
-			if (isWaterSlice(NAME, LAYER.waterMaskMap)) {
+			if (isWaterSlice(std::string(NAME), LAYER.waterMaskMap)) {
 				rgba = true;
 			}
 			#endif
@@ -668,29 +1083,36 @@ namespace Ubi {
 		#endif
 
 		const std::string &EXTENSION = nameTypeExtensionMapIterator->second.extension;
-		const std::string::size_type PERIOD_SIZE = sizeof(PERIOD);
-
-		nameOptional = NAME.substr(
-			0,
-			NAME.length() - EXTENSION.length() - PERIOD_SIZE
-		)
-
-		+ PERIOD
-		+ EXTENSION;
+		const std::string_view::size_type PERIOD_SIZE = sizeof(PERIOD);
+		const char PERIOD_STR[] = { PERIOD };
+
+		nameOptional = stringTable.add(
+			{
+				NAME.substr(
+					0,
+					NAME.length() - EXTENSION.length() - PERIOD_SIZE
+				),
+
+				std::string_view(PERIOD_STR, PERIOD_SIZE),
+				EXTENSION
+			}
+		);
 		#endif
 	}
 
-	std::string BigFile::File::getNameExtension(const std::string &name) {
-		const std::string::size_type PERIOD_SIZE = sizeof(PERIOD);
+	std::string BigFile::File::getNameExtension(std::string_view name) {
+		const std::string_view::size_type PERIOD_SIZE = sizeof(PERIOD);
 
-		std::string::size_type periodIndex = name.rfind(PERIOD);
+		std::string_view::size_type periodIndex = name.rfind(PERIOD);
 
-		return periodIndex == std::string::npos
+		return periodIndex == std::string_view::npos
 		? ""
 
-		: name.substr(
-			periodIndex + PERIOD_SIZE,
-			std::string::npos
+		: std::string(
+			name.substr(
+				periodIndex + PERIOD_SIZE,
+				std::string_view::npos
+			)
 		);
 	}
 
@@ -764,117 +1186,269 @@ namespace Ubi {
 	const std::string BigFile::Directory::NAME_CUBE = "cube";
 	const std::string BigFile::Directory::NAME_WATER = "water";
 
-	BigFile::Directory::Directory(
-		Directory* ownerDirectory,
-		std::istream &inputStream,
-		File::SIZE &fileSystemSize,
-		File::POINTER_VECTOR::size_type &files,
-		File::POINTER_SET_MAP &filePointerSetMap,
-		const std::optional<File> &layerFileOptional
-	)
-		: nameOptional(String::readOptional(inputStream)) {
-		read(ownerDirectory, inputStream, fileSystemSize, files, filePointerSetMap, layerFileOptional);
-	}
+	bool BigFile::Directory::isSet(bool bftex, const std::optional<File> &layerFileOptional) const {
+		if (bftex) {
+			return false;
+		}
 
-	BigFile::Directory::Directory(std::istream &inputStream)
-		: nameOptional(String::readOptional(inputStream)) {
-		// in this case it is the same as not having an owner
-		File::SIZE fileSystemSize = 0;
-		File::POINTER_VECTOR::size_type files = 0;
-		File::POINTER_SET_MAP filePointerSetMap = {};
-		read(false, inputStream, fileSystemSize, files, filePointerSetMap, std::nullopt);
-	}
+		if (!layerFileOptional.has_value()) {
+			return false;
+		}
 
-	BigFile::Directory::Directory(std::istream &inputStream, const Path &path, File::POINTER &filePointer) {
-		find(inputStream, path, path.directoryNameVector.begin(), filePointer);
-	}
+		const File &LAYER_FILE = layerFileOptional.value();
+
+		if (!LAYER_FILE.layerPointer) {
+			return false;
+		}
+
+		// as per usual, if we don't have a name, anything matches
+		if (!nameOptional.has_value()) {
+			return true;
+		}
 
-	BigFile::Directory::Directory(std::istream &inputStream, const Path &path, Path::NAME_VECTOR::const_iterator directoryNameVectorIterator, File::POINTER &filePointer) {
-		find(inputStream, path, directoryNameVectorIterator, filePointer);
+		const Binary::RLE::SETS_SET &SETS_SET = LAYER_FILE.layerPointer->setsSet;
+		return SETS_SET.find(std::string(nameOptional.value())) != SETS_SET.end();
 	}
 
-	void BigFile::Directory::write(std::ostream &outputStream) const {
+	void BigFile::Directory::writeIndex(std::ostream &outputStream) const {
 		String::writeOptional(outputStream, nameOptional);
 
-		DIRECTORY_VECTOR_SIZE directoryVectorSize = (DIRECTORY_VECTOR_SIZE)directoryVector.size();
-		writeStream(outputStream, &directoryVectorSize, DIRECTORY_VECTOR_SIZE_SIZE);
+		// zero means there is no owner, so the indices are written plus one
+		writeIndexSize(
+			outputStream,
 
-		for (
-			Directory::VECTOR::const_iterator directoryVectorIterator = directoryVector.begin();
-			directoryVectorIterator != directoryVector.end();
-			directoryVectorIterator++
-		) {
-			directoryVectorIterator->write(outputStream);
-		}
+			ownerIndexOptional.has_value()
+			? ownerIndexOptional.value() + 1
+			: 0
+		);
+
+		writeIndexSize(outputStream, directoriesBegin);
+		writeIndexSize(outputStream, directoriesEnd);
+		writeIndexSize(outputStream, filesBegin);
+		writeIndexSize(outputStream, binaryFilesBegin);
+		writeIndexSize(outputStream, filesEnd);
+	}
 
-		FILE_POINTER_VECTOR_SIZE fileVectorSize = (FILE_POINTER_VECTOR_SIZE)(filePointerVector.size() + binaryFilePointerVector.size());
-		writeStream(outputStream, &fileVectorSize, FILE_POINTER_VECTOR_SIZE_SIZE);
+	void BigFile::Directory::readIndex(SpanReader &indexReader, StringTable &stringTable) {
+		nameOptional = readName(indexReader, stringTable);
 
-		for (
-			File::POINTER_VECTOR::const_iterator filePointerVectorIterator = filePointerVector.begin();
-			filePointerVectorIterator != filePointerVector.end();
-			filePointerVectorIterator++
-		) {
-			(*filePointerVectorIterator)->write(outputStream);
-		}
+		VECTOR::size_type ownerIndex = readIndexSize(indexReader);
 
-		for (
-			File::POINTER_VECTOR::const_iterator binaryFilePointerVectorIterator = binaryFilePointerVector.begin();
-			binaryFilePointerVectorIterator != binaryFilePointerVector.end();
-			binaryFilePointerVectorIterator++
-		) {
-			(*binaryFilePointerVectorIterator)->write(outputStream);
+		if (ownerIndex) {
+			ownerIndexOptional = ownerIndex - 1;
 		}
-	}
 
-	BigFile::File::POINTER BigFile::Directory::find(const Path &path) const {
-		return find(path, path.directoryNameVector.begin());
+		directoriesBegin = readIndexSize(indexReader);
+		directoriesEnd = readIndexSize(indexReader);
+		filesBegin = readIndexSize(indexReader);
+		binaryFilesBegin = readIndexSize(indexReader);
+		filesEnd = readIndexSize(indexReader);
 	}
 
-	void BigFile::Directory::appendToLayerMap(
-		std::istream &inputStream,
-		File::SIZE fileSystemPosition,
-		Binary::RLE::LAYER_MAP &layerMap
-	) const {
-		appendToLayerMap(inputStream, fileSystemPosition, layerMap, binaryFilePointerVector);
+	BigFile::Header::Header(std::istream &inputStream, File::SIZE &fileSystemSize, File::SIZE &fileSystemPosition) {
+		fileSystemPosition = (File::SIZE)inputStream.tellg();
+		read(inputStream);
+		create(fileSystemSize);
+	}
 
-		for (
-			VECTOR::const_iterator directoryVectorIterator = directoryVector.begin();
-			directoryVectorIterator != directoryVector.end();
-			directoryVectorIterator++
-		) {
-			appendToLayerMap(inputStream, fileSystemPosition, layerMap, directoryVectorIterator->binaryFilePointerVector);
+	BigFile::Header::Header(std::istream &inputStream) {
+		read(inputStream);
+	}
+
+	BigFile::Header::Header(SpanReader &spanReader, File::SIZE &fileSystemSize, File::SIZE &fileSystemPosition) {
+		fileSystemPosition = (File::SIZE)spanReader.tell();
+		read(spanReader);
+		create(fileSystemSize);
+	}
+
+	BigFile::Header::Header(SpanReader &spanReader) {
+		read(spanReader);
+	}
+
+	BigFile::Header::Header() {
+	}
+
+	void BigFile::Header::write(std::ostream &outputStream) const {
+		String::writeOptional(outputStream, SIGNATURE);
+		writeStream(outputStream, &CURRENT_VERSION, VERSION_SIZE);
+	}
+
+	void BigFile::Header::create(File::SIZE &fileSystemSize) {
+		fileSystemSize += (File::SIZE)(
+			String::SIZE_SIZE
+
+			+ SIGNATURE.size() + 1
+			+ VERSION_SIZE
+		);
+	}
+
+	void BigFile::Header::read(std::istream &inputStream) {
+		std::optional<std::string> signatureOptional = String::readOptional(inputStream);
+
+		// must exactly match, case sensitively
+		if (signatureOptional != SIGNATURE) {
+			throw Invalid();
+		}
+
+		VERSION version = 0;
+		readStream(inputStream, &version, VERSION_SIZE);
+
+		if (version != CURRENT_VERSION) {
+			throw Invalid();
 		}
 	}
 
-	void BigFile::Directory::appendToTextureBoxMap(
-		std::istream &inputStream,
-		File::SIZE fileSystemPosition,
-		Binary::RLE::TEXTURE_BOX_MAP &textureBoxMap
-	) const {
-		appendToTextureBoxMap(inputStream, fileSystemPosition, textureBoxMap, binaryFilePointerVector);
+	void BigFile::Header::read(SpanReader &spanReader) {
+		// viewed in place, there is no need to copy the signature just to compare it
+		std::optional<std::string_view> signatureOptional = String::readOptionalView(spanReader);
 
-		for (
-			VECTOR::const_iterator directoryVectorIterator = directoryVector.begin();
-			directoryVectorIterator != directoryVector.end();
-			directoryVectorIterator++
-		) {
-			appendToTextureBoxMap(inputStream, fileSystemPosition, textureBoxMap, directoryVectorIterator->binaryFilePointerVector);
+		if (signatureOptional != SIGNATURE) {
+			throw Invalid();
+		}
+
+		VERSION version = 0;
+		spanReader.read(&version, VERSION_SIZE);
+
+		if (version != CURRENT_VERSION) {
+			throw Invalid();
 		}
 	}
 
-	void BigFile::Directory::read(
-		bool owner,
-		std::istream &inputStream,
+	const std::string BigFile::Header::SIGNATURE = "UBI_BF_SIG";
+
+	BigFile::Cursor::Cursor(std::istream &inputStream)
+		: inputStream(inputStream) {
+	}
+
+	bool BigFile::Cursor::next() {
+		// the root directory is the first record
+		if (!begun) {
+			begun = true;
+			readDirectory();
+			return true;
+		}
+
+		while (!frameVector.empty()) {
+			if (step()) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void BigFile::Cursor::skip() {
+		// the rest of this directory is read through the same buffer, so nothing is allocated for it
+		// (the record is overwritten in the meantime, but it isn't valid until next is called anyway)
+		const Frame::VECTOR::size_type FRAME_VECTOR_SIZE = frameVector.size();
+
+		if (!FRAME_VECTOR_SIZE) {
+			return;
+		}
+
+		while (frameVector.size() >= FRAME_VECTOR_SIZE) {
+			step();
+		}
+	}
+
+	const BigFile::Cursor::Record &BigFile::Cursor::get() const {
+		return record;
+	}
+
+	size_t BigFile::Cursor::getDepth() const {
+		// this is the depth of the directory the record is in (or is) where the root directory is zero
+		if (frameVector.empty()) {
+			throw std::logic_error("frameVector must not be empty");
+		}
+		return frameVector.size() - 1;
+	}
+
+	bool BigFile::Cursor::step() {
+		// this returns false if there was no record, because the cursor left a directory
+		Frame &frame = frameVector.back();
+
+		// the directories in a directory are before its files
+		if (frame.directories) {
+			frame.directories--;
+			readDirectory();
+			return true;
+		}
+
+		if (!frame.filesOptional.has_value()) {
+			Directory::FILE_POINTER_VECTOR_SIZE files = 0;
+			readStream(inputStream, &files, Directory::FILE_POINTER_VECTOR_SIZE_SIZE);
+			frame.filesOptional = files;
+		}
+
+		Directory::FILE_POINTER_VECTOR_SIZE &files = frame.filesOptional.value();
+
+		if (!files) {
+			frameVector.pop_back();
+			return false;
+		}
+
+		files--;
+
+		record.type = TYPE::FILE;
+		record.nameOptional = readNameOptional();
+		readStream(inputStream, &record.size, File::SIZE_SIZE);
+		readStream(inputStream, &record.position, File::POSITION_SIZE);
+		return true;
+	}
+
+	void BigFile::Cursor::readDirectory() {
+		record.type = TYPE::DIRECTORY;
+		record.nameOptional = readNameOptional();
+		record.size = 0;
+		record.position = 0;
+
+		Frame frame = {};
+		readStream(inputStream, &frame.directories, Directory::DIRECTORY_VECTOR_SIZE_SIZE);
+		frameVector.push_back(frame);
+	}
+
+	std::optional<std::string_view> BigFile::Cursor::readNameOptional() {
+		String::SIZE size = 0;
+		readStream(inputStream, &size, String::SIZE_SIZE);
+
+		if (!size) {
+			return std::nullopt;
+		}
+
+		// the buffer only ever grows, so after the first few names there is nothing to allocate
+		if (name.size() < size) {
+			name.resize(size);
+		}
+
+		char* str = name.data();
+		readStream(inputStream, str, size);
+
+		// same as String::readOptional, which stops at the first null character
+		return std::string_view(str, strnlen(str, size));
+	}
+
+	template <typename Reader>
+	void BigFile::read(Reader &reader, File::SIZE &fileSystemSize, const std::optional<File> &layerFileOptional) {
+		directoryVector.resize(1);
+		readDirectory(0, reader, fileSystemSize, layerFileOptional);
+		createPathEntryVectorMap();
+	}
+
+	template <typename Reader>
+	void BigFile::readDirectory(
+		Directory::VECTOR::size_type directoryIndex,
+		Reader &reader,
 		File::SIZE &fileSystemSize,
-		File::POINTER_VECTOR::size_type &files,
-		File::POINTER_SET_MAP &filePointerSetMap,
 		const std::optional<File> &layerFileOptional
 	) {
-		DIRECTORY_VECTOR_SIZE directoryVectorSize = 0;
-		readStream(inputStream, &directoryVectorSize, DIRECTORY_VECTOR_SIZE_SIZE);
+		// the directoryVector grows while the directories in it are being read
+		// so directories must always be looked up by their index, as references to them won't last
+		std::optional<std::string_view> nameOptional = readName(reader, stringTable);
+		directoryVector[directoryIndex].nameOptional = nameOptional;
 
-		bool bftex = !owner
+		Directory::DIRECTORY_VECTOR_SIZE directoryVectorSize = 0;
+		readBuffer(reader, &directoryVectorSize, Directory::DIRECTORY_VECTOR_SIZE_SIZE);
+
+		bool bftex = !directoryVector[directoryIndex].ownerIndexOptional.has_value()
 
 		&& (
 			nameOptional.has_value()
@@ -882,13 +1456,21 @@ namespace Ubi {
 			: true
 		);
 
-		for (DIRECTORY_VECTOR_SIZE i = 0; i < directoryVectorSize; i++) {
-			directoryVector.emplace_back(
-				this,
-				inputStream,
+		// the directories are all added before reading any of them, so that they are next to each other
+		Directory::VECTOR::size_type directoriesBegin = directoryVector.size();
+		Directory::VECTOR::size_type directoriesEnd = directoriesBegin + directoryVectorSize;
+		directoryVector.resize(directoriesEnd);
+
+		directoryVector[directoryIndex].directoriesBegin = directoriesBegin;
+		directoryVector[directoryIndex].directoriesEnd = directoriesEnd;
+
+		for (Directory::VECTOR::size_type i = directoriesBegin; i < directoriesEnd; i++) {
+			directoryVector[i].ownerIndexOptional = directoryIndex;
+
+			readDirectory(
+				i,
+				reader,
 				fileSystemSize,
-				files,
-				filePointerSetMap,
 
 				// only if this directory matches the "bftex" name, pass the file
 				// (if this directory has no name, any name matches, so the file is passed)
@@ -898,47 +1480,39 @@ namespace Ubi {
 			);
 		}
 
-		bool set = isSet(bftex, layerFileOptional);
+		bool set = directoryVector[directoryIndex].isSet(bftex, layerFileOptional);
 
-		File::POINTER filePointer = 0;
-		File::POINTER_SET_MAP::iterator filePointerSetMapIterator = {};
+		Directory::FILE_POINTER_VECTOR_SIZE filePointerVectorSize = 0;
+		readBuffer(reader, &filePointerVectorSize, Directory::FILE_POINTER_VECTOR_SIZE_SIZE);
 
-		FILE_POINTER_VECTOR_SIZE filePointerVectorSize = 0;
-		readStream(inputStream, &filePointerVectorSize, FILE_POINTER_VECTOR_SIZE_SIZE);
+		File::VECTOR::size_type filesBegin = fileVector.size();
 
-		for (FILE_POINTER_VECTOR_SIZE i = 0; i < filePointerVectorSize; i++) {
-			filePointer = std::make_shared<File>(
-				inputStream,
+		for (Directory::FILE_POINTER_VECTOR_SIZE i = 0; i < filePointerVectorSize; i++) {
+			fileVector.emplace_back(
+				reader,
+				stringTable,
 				fileSystemSize,
 
 				set
 				? layerFileOptional
 				: std::nullopt
 			);
+		}
 
-			const File &FILE = *filePointer;
-
-			if (FILE.type == File::TYPE::BINARY) {
-				binaryFilePointerVector.push_back(filePointer);
-			} else {
-				filePointerVector.push_back(filePointer);
-			}
-
-			const Ubi::BigFile::File::SIZE &POSITION = FILE.position;
-
-			// are there any other files at this position?
-			filePointerSetMapIterator = filePointerSetMap.find(POSITION);
+		// the Binary files go after the rest, but otherwise they must stay in the same order
+		File::VECTOR::iterator binaryFilesBeginIterator = std::stable_partition(
+			fileVector.begin() + filesBegin,
+			fileVector.end(),
 
-			// if not, then create a new set
-			if (filePointerSetMapIterator == filePointerSetMap.end()) {
-				filePointerSetMapIterator = filePointerSetMap.insert({ POSITION, {} }).first;
+			[](const File &file) {
+				return file.type != File::TYPE::BINARY;
 			}
+		);
 
-			// add this file to the set
-			filePointerSetMapIterator->second.insert(filePointer);
-		}
-
-		files += filePointerVectorSize;
+		Directory &directory = directoryVector[directoryIndex];
+		directory.filesBegin = filesBegin;
+		directory.binaryFilesBegin = binaryFilesBeginIterator - fileVector.begin();
+		directory.filesEnd = fileVector.size();
 
 		fileSystemSize += (File::SIZE)(
 			String::SIZE_SIZE
@@ -949,246 +1523,287 @@ namespace Ubi {
 				: 0
 			)
 
-			+ DIRECTORY_VECTOR_SIZE_SIZE
-			+ FILE_POINTER_VECTOR_SIZE_SIZE
+			+ Directory::DIRECTORY_VECTOR_SIZE_SIZE
+			+ Directory::FILE_POINTER_VECTOR_SIZE_SIZE
 		);
 	}
 
-	void BigFile::Directory::find(std::istream &inputStream, const Path &path, Path::NAME_VECTOR::const_iterator directoryNameVectorIterator, File::POINTER &filePointer) {
-		MAKE_SCOPE_EXIT(filePointerScopeExit) {
-			filePointer = 0;
-		};
+	void BigFile::readIndex(SpanReader &indexReader, File::SIZE &fileSystemSize) {
+		File::SIZE indexFileSystemSize = 0;
+		indexReader.read(&fileSystemPosition, File::POSITION_SIZE);
+		indexReader.read(&indexFileSystemSize, File::SIZE_SIZE);
+		fileSystemSize += indexFileSystemSize;
 
-		const Path::NAME_VECTOR &DIRECTORY_NAME_VECTOR = path.directoryNameVector;
+		// there must always be a root directory
+		Directory::VECTOR::size_type directoryVectorSize = readIndexSize(indexReader);
 
-		// isMatch must be called here, modifies directoryNameVectorIterator
-		nameOptional = String::readOptional(inputStream);
-		bool match = isMatch(DIRECTORY_NAME_VECTOR, directoryNameVectorIterator);
-
-		DIRECTORY_VECTOR_SIZE directoryVectorSize = 0;
-		readStream(inputStream, &directoryVectorSize, DIRECTORY_VECTOR_SIZE_SIZE);
-
-		if (directoryNameVectorIterator == DIRECTORY_NAME_VECTOR.end()) {
-			// in this case we just read the directories and don't bother checking filePointer
-			for (DIRECTORY_VECTOR_SIZE i = 0; i < directoryVectorSize; i++) {
-				Directory directory(
-					inputStream,
-					path,
-					directoryNameVectorIterator,
-					filePointer
-				);
+		if (!directoryVectorSize) {
+			throw Invalid();
+		}
+
+		File::VECTOR::size_type fileVectorSize = readIndexSize(indexReader);
+
+		directoryVector.resize(directoryVectorSize);
+
+		for (
+			Directory::VECTOR::iterator directoryVectorIterator = directoryVector.begin();
+			directoryVectorIterator != directoryVector.end();
+			directoryVectorIterator++
+		) {
+			directoryVectorIterator->readIndex(indexReader, stringTable);
+		}
+
+		fileVector.reserve(fileVectorSize);
+
+		for (File::VECTOR::size_type i = 0; i < fileVectorSize; i++) {
+			fileVector.emplace_back(indexReader, stringTable);
+		}
+
+		// the directories are only ever after the directory that owns them
+		// so checking that here means the record can't make find or write loop forever
+		for (Directory::VECTOR::size_type i = 0; i < directoryVectorSize; i++) {
+			const Directory &DIRECTORY = directoryVector[i];
+
+			if (DIRECTORY.ownerIndexOptional.has_value() && DIRECTORY.ownerIndexOptional.value() >= i) {
+				throw Invalid();
 			}
-		} else {
-			for (DIRECTORY_VECTOR_SIZE i = 0; i < directoryVectorSize; i++) {
-				directoryVector.emplace_back(
-					inputStream,
-					path,
-					directoryNameVectorIterator,
-					filePointer
-				);
 
-				// if this is true we found the matching file, so exit early
-				if (filePointer) {
-					// erase all but the last element
-					// (there should always be at least one element in the vector at this point)
-					directoryVector.erase(directoryVector.begin(), directoryVector.end() - 1);
-					filePointerScopeExit.dismiss();
-					return;
-				}
+			if (DIRECTORY.directoriesBegin > DIRECTORY.directoriesEnd
+				|| DIRECTORY.directoriesEnd > directoryVectorSize
+				|| (DIRECTORY.directoriesBegin != DIRECTORY.directoriesEnd && DIRECTORY.directoriesBegin <= i)) {
+				throw Invalid();
 			}
 
-			directoryVector = {};
+			if (DIRECTORY.filesBegin > DIRECTORY.binaryFilesBegin
+				|| DIRECTORY.binaryFilesBegin > DIRECTORY.filesEnd
+				|| DIRECTORY.filesEnd > fileVectorSize) {
+				throw Invalid();
+			}
 		}
 
-		FILE_POINTER_VECTOR_SIZE filePointerVectorSize = 0;
-		readStream(inputStream, &filePointerVectorSize, FILE_POINTER_VECTOR_SIZE_SIZE);
+		createPathEntryVectorMap();
+	}
+
+	void BigFile::createPathEntryVectorMap() {
+		// a path can only match directories at the same depth, and those are in the directoryVector
+		// in the same order that searching from the root directory would go through them
+		// so the first match here is the same one that searching would find
+		PathEntry::VECTOR_MAP::iterator pathEntryVectorMapIterator = {};
+		PathEntry pathEntry = {};
 
-		if (match) {
-			for (FILE_POINTER_VECTOR_SIZE i = 0; i < filePointerVectorSize; i++) {
-				filePointer = std::make_shared<File>(inputStream);
-				filePointerVector.push_back(filePointer);
+		for (Directory::VECTOR::size_type i = 0; i < directoryVector.size(); i++) {
+			const Directory &DIRECTORY = directoryVector[i];
 
-				// is this the file we are looking for?
-				if (filePointer->nameOptional == path.fileName) {
-					// erase all but the last element
-					// (there should always be at least one element in the vector at this point)
-					filePointerVector.erase(filePointerVector.begin(), filePointerVector.end() - 1);
-					filePointerScopeExit.dismiss();
-					return;
+			// only the files that aren't Binary files
+			for (File::VECTOR::size_type j = DIRECTORY.filesBegin; j < DIRECTORY.binaryFilesBegin; j++) {
+				const std::optional<std::string_view> &NAME_OPTIONAL = fileVector[j].nameOptional;
+
+				if (!NAME_OPTIONAL.has_value()) {
+					continue;
+				}
+
+				pathEntryVectorMapIterator = pathEntryVectorMap.find(NAME_OPTIONAL.value());
+
+				if (pathEntryVectorMapIterator == pathEntryVectorMap.end()) {
+					pathEntryVectorMapIterator = pathEntryVectorMap.insert({ NAME_OPTIONAL.value(), {} }).first;
 				}
+
+				pathEntry.directoryIndex = i;
+				pathEntry.fileIndex = j;
+				pathEntryVectorMapIterator->second.push_back(pathEntry);
 			}
+		}
+	}
+
+	void BigFile::create(File::POINTER_VECTOR::size_type &files) {
+		// this must only be done once fileVector is done being read, so the indices into it will last
+		const File::VECTOR::size_type FILE_VECTOR_SIZE = fileVector.size();
+		positionVector.reserve(FILE_VECTOR_SIZE);
 
-			filePointerVector = {};
-		} else {
-			for (FILE_POINTER_VECTOR_SIZE i = 0; i < filePointerVectorSize; i++) {
-				File file(inputStream);
+		for (File::VECTOR::size_type i = 0; i < FILE_VECTOR_SIZE; i++) {
+			positionVector.push_back({ fileVector[i].position, (Position::FILE_INDEX)i });
+		}
+
+		// the files are usually already in order, in which case there is nothing to sort
+		if (!std::is_sorted(
+			positionVector.begin(),
+			positionVector.end(),
+			[](const Position &a, const Position &b) {
+				return a.position < b.position;
 			}
+		)) {
+			sortPositionVector();
 		}
+
+		files += FILE_VECTOR_SIZE;
 	}
 
-	BigFile::File::POINTER BigFile::Directory::find(const Path &path, Path::NAME_VECTOR::const_iterator directoryNameVectorIterator) const {
-		const Path::NAME_VECTOR &DIRECTORY_NAME_VECTOR = path.directoryNameVector;
+	void BigFile::sortPositionVector() {
+		// this is a radix sort, one byte of the position at a time, from the least significant byte
+		// every pass is stable, so files at the same position stay in the order they are in the fileVector
+		const size_t RADIX = 256;
+		const size_t BITS = 8;
+		const Position::VECTOR::size_type POSITION_VECTOR_SIZE = positionVector.size();
+
+		Position::VECTOR sortedPositionVector(POSITION_VECTOR_SIZE);
+		Position::VECTOR::size_type counts[RADIX] = {};
+		Position::VECTOR::size_type count = 0;
+		Position::VECTOR::size_type offset = 0;
 
-		// isMatch must be called here, modifies directoryNameVectorIterator
-		bool match = isMatch(DIRECTORY_NAME_VECTOR, directoryNameVectorIterator);
-		File::POINTER filePointer = 0;
+		for (size_t shift = 0; shift < sizeof(File::SIZE) * BITS; shift += BITS) {
+			std::fill(counts, counts + RADIX, 0);
 
-		if (directoryNameVectorIterator != DIRECTORY_NAME_VECTOR.end()) {
 			for (
-				VECTOR::const_iterator directoryVectorIterator = directoryVector.begin();
-				directoryVectorIterator != directoryVector.end();
-				directoryVectorIterator++
+				Position::VECTOR::const_iterator positionVectorIterator = positionVector.begin();
+				positionVectorIterator != positionVector.end();
+				positionVectorIterator++
 			) {
-				filePointer = directoryVectorIterator->find(path, directoryNameVectorIterator);
+				counts[(positionVectorIterator->position >> shift) & (RADIX - 1)]++;
+			}
 
-				// if this is true we found the matching file, so exit early
-				if (filePointer) {
-					return filePointer;
-				}
+			// if every position has the same byte here, this pass wouldn't move anything
+			if (counts[(positionVector.front().position >> shift) & (RADIX - 1)] == POSITION_VECTOR_SIZE) {
+				continue;
 			}
-		}
 
-		if (!match) {
-			return 0;
-		}
+			// the counts become the offsets to put the positions at
+			offset = 0;
 
-		for (
-			File::POINTER_VECTOR::const_iterator filePointerVectorIterator = filePointerVector.begin();
-			filePointerVectorIterator != filePointerVector.end();
-			filePointerVectorIterator++
-		) {
-			filePointer = *filePointerVectorIterator;
+			for (size_t i = 0; i < RADIX; i++) {
+				count = counts[i];
+				counts[i] = offset;
+				offset += count;
+			}
 
-			// is this the file we are looking for?
-			if (filePointer && filePointer->nameOptional == path.fileName) {
-				return filePointer;
+			for (
+				Position::VECTOR::const_iterator positionVectorIterator = positionVector.begin();
+				positionVectorIterator != positionVector.end();
+				positionVectorIterator++
+			) {
+				sortedPositionVector[counts[(positionVectorIterator->position >> shift) & (RADIX - 1)]++] = *positionVectorIterator;
 			}
+
+			positionVector.swap(sortedPositionVector);
 		}
-		return 0;
 	}
 
-	bool BigFile::Directory::isMatch(const Path::NAME_VECTOR &directoryNameVector, Path::NAME_VECTOR::const_iterator &directoryNameVectorIterator) const {
-		// should we care about this directory at all?
-		if (directoryNameVectorIterator == directoryNameVector.end()) {
-			return false;
-		}
+	void BigFile::write(std::ostream &outputStream, const Directory &directory) const {
+		String::writeOptional(outputStream, directory.nameOptional);
 
-		// does this directory's name match the one we are trying to find?
-		if (nameOptional.has_value() && nameOptional.value() != *directoryNameVectorIterator) {
-			directoryNameVectorIterator = directoryNameVector.end();
-			return false;
-		}
-		return ++directoryNameVectorIterator == directoryNameVector.end();
-	}
+		Directory::DIRECTORY_VECTOR_SIZE directoryVectorSize = (Directory::DIRECTORY_VECTOR_SIZE)(directory.directoriesEnd - directory.directoriesBegin);
+		writeStream(outputStream, &directoryVectorSize, Directory::DIRECTORY_VECTOR_SIZE_SIZE);
 
-	bool BigFile::Directory::isSet(bool bftex, const std::optional<File> &layerFileOptional) const {
-		if (bftex) {
-			return false;
+		for (Directory::VECTOR::size_type i = directory.directoriesBegin; i < directory.directoriesEnd; i++) {
+			write(outputStream, directoryVector[i]);
 		}
 
-		if (!layerFileOptional.has_value()) {
-			return false;
+		// the Binary files are already after the rest
+		Directory::FILE_POINTER_VECTOR_SIZE fileVectorSize = (Directory::FILE_POINTER_VECTOR_SIZE)(directory.filesEnd - directory.filesBegin);
+		writeStream(outputStream, &fileVectorSize, Directory::FILE_POINTER_VECTOR_SIZE_SIZE);
+
+		for (File::VECTOR::size_type i = directory.filesBegin; i < directory.filesEnd; i++) {
+			fileVector[i].write(outputStream);
 		}
+	}
 
-		const File &LAYER_FILE = layerFileOptional.value();
+	bool BigFile::isMatch(const Path &path, Directory::VECTOR::size_type directoryIndex) const {
+		// this goes from the directory up to the root directory, so the path is matched from the end to the beginning
+		const Path::NAME_VECTOR &DIRECTORY_NAME_VECTOR = path.directoryNameVector;
+		Path::NAME_VECTOR::const_reverse_iterator directoryNameVectorIterator = DIRECTORY_NAME_VECTOR.rbegin();
+		std::optional<Directory::VECTOR::size_type> directoryIndexOptional = directoryIndex;
 
-		Binary::RLE::LAYER_MAP_POINTER layerMapPointer = LAYER_FILE.layerMapPointer;
+		while (directoryIndexOptional.has_value()) {
+			// the path isn't as deep as this directory
+			if (directoryNameVectorIterator == DIRECTORY_NAME_VECTOR.rend()) {
+				return false;
+			}
 
-		if (!layerMapPointer) {
-			return false;
-		}
+			const Directory &DIRECTORY = directoryVector[directoryIndexOptional.value()];
 
-		// as per usual, if we don't have a name, anything matches
-		if (!nameOptional.has_value()) {
-			return true;
+			// as per usual, if we don't have a name, anything matches
+			if (DIRECTORY.nameOptional.has_value() && DIRECTORY.nameOptional.value() != *directoryNameVectorIterator) {
+				return false;
+			}
+
+			directoryNameVectorIterator++;
+			directoryIndexOptional = DIRECTORY.ownerIndexOptional;
 		}
 
-		const Binary::RLE::SETS_SET &SETS_SET = LAYER_FILE.layerMapIterator->second.setsSet;
-		return SETS_SET.find(nameOptional.value()) != SETS_SET.end();
+		// the path must not be deeper than this directory either
+		return directoryNameVectorIterator == DIRECTORY_NAME_VECTOR.rend();
 	}
 
-	void BigFile::Directory::appendToLayerMap(
-		std::istream &inputStream,
-		File::SIZE fileSystemPosition,
-		Binary::RLE::LAYER_MAP &layerMap,
-		const File::POINTER_VECTOR &binaryFilePointerVector
-	) const {
-		for (
-			File::POINTER_VECTOR::const_iterator binaryFilePointerVectorIterator = binaryFilePointerVector.begin();
-			binaryFilePointerVectorIterator != binaryFilePointerVector.end();
-			binaryFilePointerVectorIterator++
-		) {
-			(*binaryFilePointerVectorIterator)->appendToLayerMap(inputStream, fileSystemPosition, layerMap);
+	void BigFile::appendToLayerMap(std::istream &inputStream, const Directory &directory) {
+		appendToLayerMap(inputStream, directory.binaryFilesBegin, directory.filesEnd);
+
+		for (Directory::VECTOR::size_type i = directory.directoriesBegin; i < directory.directoriesEnd; i++) {
+			const Directory &DIRECTORY = directoryVector[i];
+			appendToLayerMap(inputStream, DIRECTORY.binaryFilesBegin, DIRECTORY.filesEnd);
 		}
 	}
 
-	void BigFile::Directory::appendToTextureBoxMap(
-		std::istream &inputStream,
-		File::SIZE fileSystemPosition,
-		Binary::RLE::TEXTURE_BOX_MAP &textureBoxMap,
-		const File::POINTER_VECTOR &binaryFilePointerVector
-	) const {
-		for (
-			File::POINTER_VECTOR::const_iterator binaryFilePointerVectorIterator = binaryFilePointerVector.begin();
-			binaryFilePointerVectorIterator != binaryFilePointerVector.end();
-			binaryFilePointerVectorIterator++
-		) {
-			(*binaryFilePointerVectorIterator)->appendToTextureBoxMap(inputStream, fileSystemPosition, textureBoxMap);
+	void BigFile::appendToLayerMap(std::istream &inputStream, File::VECTOR::size_type binaryFilesBegin, File::VECTOR::size_type binaryFilesEnd) {
+		for (File::VECTOR::size_type i = binaryFilesBegin; i < binaryFilesEnd; i++) {
+			fileVector[i].appendToLayerMap(inputStream, fileSystemPosition, layerMap);
 		}
 	}
 
-	BigFile::Header::Header(std::istream &inputStream, File::SIZE &fileSystemSize, File::SIZE &fileSystemPosition) {
-		fileSystemPosition = (File::SIZE)inputStream.tellg();
-		read(inputStream);
+	void BigFile::appendToTextureBoxMap(std::istream &inputStream, const Directory &directory, Binary::RLE::TEXTURE_BOX_MAP &textureBoxMap) const {
+		appendToTextureBoxMap(inputStream, directory.binaryFilesBegin, directory.filesEnd, textureBoxMap);
 
-		fileSystemSize += (File::SIZE)(
-			String::SIZE_SIZE
-
-			+ SIGNATURE.size() + 1
-			+ VERSION_SIZE
-		);
-	}
-
-	BigFile::Header::Header(std::istream &inputStream) {
-		read(inputStream);
+		for (Directory::VECTOR::size_type i = directory.directoriesBegin; i < directory.directoriesEnd; i++) {
+			const Directory &DIRECTORY = directoryVector[i];
+			appendToTextureBoxMap(inputStream, DIRECTORY.binaryFilesBegin, DIRECTORY.filesEnd, textureBoxMap);
+		}
 	}
 
-	BigFile::Header::Header(std::istream &inputStream, File::POINTER &filePointer) {
-		// for path vectors
-		if (filePointer) {
-			inputStream.seekg(filePointer->position);
+	void BigFile::appendToTextureBoxMap(std::istream &inputStream, File::VECTOR::size_type binaryFilesBegin, File::VECTOR::size_type binaryFilesEnd, Binary::RLE::TEXTURE_BOX_MAP &textureBoxMap) const {
+		for (File::VECTOR::size_type i = binaryFilesBegin; i < binaryFilesEnd; i++) {
+			fileVector[i].appendToTextureBoxMap(inputStream, fileSystemPosition, textureBoxMap);
 		}
-
-		read(inputStream);
 	}
 
-	void BigFile::Header::write(std::ostream &outputStream) const {
-		String::writeOptional(outputStream, SIGNATURE);
-		writeStream(outputStream, &CURRENT_VERSION, VERSION_SIZE);
-	}
+	bool BigFile::find(std::istream &inputStream, const Path &path, std::optional<File> &fileOptional) {
+		// this reads the directories without keeping them, so it can stop as soon as the file is found
+		// and any directory that isn't on the path is skipped, along with everything in it
+		const Path::NAME_VECTOR &DIRECTORY_NAME_VECTOR = path.directoryNameVector;
 
-	void BigFile::Header::read(std::istream &inputStream) {
-		std::optional<std::string> signatureOptional = String::readOptional(inputStream);
+		Cursor cursor(inputStream);
+		size_t depth = 0;
 
-		// must exactly match, case sensitively
-		if (signatureOptional != SIGNATURE) {
-			throw Invalid();
-		}
+		while (cursor.next()) {
+			const Cursor::Record &RECORD = cursor.get();
+			depth = cursor.getDepth();
 
-		VERSION version = 0;
-		readStream(inputStream, &version, VERSION_SIZE);
+			if (RECORD.type == Cursor::TYPE::DIRECTORY) {
+				// as per usual, if the directory doesn't have a name, anything matches
+				if (depth >= DIRECTORY_NAME_VECTOR.size()
+					|| (RECORD.nameOptional.has_value() && RECORD.nameOptional.value() != DIRECTORY_NAME_VECTOR[depth])) {
+					cursor.skip();
+				}
+				continue;
+			}
 
-		if (version != CURRENT_VERSION) {
-			throw Invalid();
+			// the file can only be in the last directory of the path, so the rest of the files in this one aren't it
+			if (depth + 1 != DIRECTORY_NAME_VECTOR.size()) {
+				cursor.skip();
+				continue;
+			}
+
+			// is this the file we are looking for?
+			if (RECORD.nameOptional == path.fileName) {
+				fileOptional.emplace(RECORD.size);
+				fileOptional.value().position = RECORD.position;
+				return true;
+			}
 		}
+		return false;
 	}
 
-	const std::string BigFile::Header::SIGNATURE = "UBI_BF_SIG";
-
-	BigFile::File::POINTER BigFile::findFile(std::istream &stream, const Path::VECTOR &pathVector) {
+	BigFile::File BigFile::findFile(std::istream &stream, const Path::VECTOR &pathVector) {
 		stream.seekg(0);
 
-		File::POINTER filePointer = 0;
+		std::optional<File> fileOptional = std::nullopt;
 		std::streampos position = 0;
 
 		for (
@@ -1196,39 +1811,39 @@ namespace Ubi {
 			pathVectorIterator != pathVector.end();
 			pathVectorIterator++
 		) {
-			BigFile bigFile(stream, *pathVectorIterator, filePointer);
+			const Path &PATH = *pathVectorIterator;
 
-			if (!filePointer) {
-				throw std::logic_error("filePointer must not be zero");
+			Header header(stream);
+
+			if (!find(stream, PATH, fileOptional)) {
+				throw std::logic_error("fileOptional must have a value");
 			}
 
-			stream.seekg(position + (std::streampos)filePointer->position);
+			stream.seekg(position + (std::streampos)fileOptional.value().position);
 			position = stream.tellg();
 		}
-		return filePointer;
+		return fileOptional.value();
 	}
 
-	BigFile::BigFile(std::istream &inputStream, File::SIZE &fileSystemSize, File::POINTER_VECTOR::size_type &files, File::POINTER_SET_MAP &filePointerSetMap, File &file)
-		: header(inputStream, fileSystemSize, fileSystemPosition),
-		directory(0, inputStream, fileSystemSize, files, filePointerSetMap, file) {
+	void BigFile::createLayerMap(std::istream &inputStream) {
 		// do all the steps necessary to prevent water causing a crash
 		// note: the Binarizer seems hardcoded to put cubes and water in a cube and water directory
 		// so we use that fact instead of loading every file in binarizer_loader.log like the game does
 		#ifdef LAYERS_ENABLED
-		const Directory::VECTOR &DIRECTORY_VECTOR = directory.directoryVector;
+		const Directory &ROOT_DIRECTORY = directoryVector.front();
 
 		Directory::VECTOR_ITERATOR_VECTOR cubeVectorIterators = {};
 		Directory::VECTOR_ITERATOR_VECTOR waterVectorIterators = {};
 
 		for (
-			Directory::VECTOR::const_iterator directoryVectorIterator = DIRECTORY_VECTOR.begin();
-			directoryVectorIterator != DIRECTORY_VECTOR.end();
+			Directory::VECTOR::const_iterator directoryVectorIterator = directoryVector.begin() + ROOT_DIRECTORY.directoriesBegin;
+			directoryVectorIterator != directoryVector.begin() + ROOT_DIRECTORY.directoriesEnd;
 			directoryVectorIterator++
 		) {
-			const std::optional<std::string> &NAME_OPTIONAL = directoryVectorIterator->nameOptional;
+			const std::optional<std::string_view> &NAME_OPTIONAL = directoryVectorIterator->nameOptional;
 
 			if (NAME_OPTIONAL.has_value()) {
-				const std::string &NAME = NAME_OPTIONAL.value();
+				const std::string_view &NAME = NAME_OPTIONAL.value();
 
 				if (NAME == Directory::NAME_CUBE) {
 					cubeVectorIterators.push_back(directoryVectorIterator);
@@ -1242,15 +1857,12 @@ namespace Ubi {
 			return;
 		}
 
-		Binary::RLE::LAYER_MAP_POINTER layerMapPointer = std::make_shared<Binary::RLE::LAYER_MAP>();
-		Binary::RLE::LAYER_MAP &layerMap = *layerMapPointer;
-
 		for (
 			Directory::VECTOR_ITERATOR_VECTOR::iterator cubeVectorIteratorsIterator = cubeVectorIterators.begin();
 			cubeVectorIteratorsIterator != cubeVectorIterators.end();
 			cubeVectorIteratorsIterator++
 		) {
-			(*cubeVectorIteratorsIterator)->appendToLayerMap(inputStream, fileSystemPosition, layerMap);
+			appendToLayerMap(inputStream, **cubeVectorIteratorsIterator);
 		}
 
 		if (layerMap.empty()) {
@@ -1264,7 +1876,7 @@ namespace Ubi {
 			waterVectorIteratorsIterator != waterVectorIterators.end();
 			waterVectorIteratorsIterator++
 		) {
-			(*waterVectorIteratorsIterator)->appendToTextureBoxMap(inputStream, fileSystemPosition, textureBoxMap);
+			appendToTextureBoxMap(inputStream, **waterVectorIteratorsIterator, textureBoxMap);
 		}
 
 		std::streampos position = inputStream.tellg();
@@ -1303,7 +1915,7 @@ namespace Ubi {
 					maskPathSetIterator != MASK_PATH_SET.end();
 					maskPathSetIterator++
 				) {
-					layerFilePointer = directory.find(*maskPathSetIterator);
+					layerFilePointer = find(*maskPathSetIterator);
 
 					if (!layerFilePointer) {
 						continue;
@@ -1314,55 +1926,125 @@ namespace Ubi {
 
 					BigFile maskBigFile(inputStream);
 
-					File::POINTER_VECTOR &maskFilePointerVector = maskBigFile.directory.filePointerVector;
+					const File::VECTOR &MASK_FILE_VECTOR = maskBigFile.fileVector;
+					const Directory &MASK_ROOT_DIRECTORY = maskBigFile.directoryVector.front();
 
+					// only the files that aren't Binary files
 					for (
-						File::POINTER_VECTOR::iterator maskFilePointerVectorIterator = maskFilePointerVector.begin();
-						maskFilePointerVectorIterator != maskFilePointerVector.end();
-						maskFilePointerVectorIterator++
+						File::VECTOR::const_iterator maskFileVectorIterator = MASK_FILE_VECTOR.begin() + MASK_ROOT_DIRECTORY.filesBegin;
+						maskFileVectorIterator != MASK_FILE_VECTOR.begin() + MASK_ROOT_DIRECTORY.binaryFilesBegin;
+						maskFileVectorIterator++
 					) {
-						File &maskFile = **maskFilePointerVectorIterator;
+						const File &MASK_FILE = *maskFileVectorIterator;
 
-						if (!maskFile.nameOptional.has_value()) {
+						if (!MASK_FILE.nameOptional.has_value()) {
 							continue;
 						}
 
-						fileFaceStrMapIterator = Binary::RLE::FILE_FACE_STR_MAP.find(maskFile.nameOptional.value());
+						fileFaceStrMapIterator = Binary::RLE::FILE_FACE_STR_MAP.find(std::string(MASK_FILE.nameOptional.value()));
 
 						if (fileFaceStrMapIterator == Binary::RLE::FILE_FACE_STR_MAP.end()) {
 							continue;
 						}
 
-						inputStream.seekg(maskFileSystemPosition + (std::streampos)maskFile.position);
+						inputStream.seekg(maskFileSystemPosition + (std::streampos)MASK_FILE.position);
 
-						Binary::RLE::appendToSliceMap(inputStream, maskFile.size, waterMaskMap[fileFaceStrMapIterator->second]);
+						Binary::RLE::appendToSliceMap(inputStream, MASK_FILE.size, waterMaskMap[fileFaceStrMapIterator->second]);
 					}
 				}
 			}
 
-			layerFilePointer = directory.find(layerMapIterator->first);
+			layerFilePointer = find(layerMapIterator->first);
 
 			if (layerFilePointer) {
-				File &layerFile = *layerFilePointer;
-				layerFile.layerMapPointer = layerMapPointer;
-				layerFile.layerMapIterator = layerMapIterator;
+				layerFilePointer->layerPointer = &layerMapIterator->second;
 			}
 		}
 		#endif
 	}
 
+	BigFile::BigFile(std::istream &inputStream, File::SIZE &fileSystemSize, File::POINTER_VECTOR::size_type &files, File &file)
+		: header(inputStream, fileSystemSize, fileSystemPosition) {
+		read(inputStream, fileSystemSize, file);
+		createLayerMap(inputStream);
+		create(files);
+	}
+
+	BigFile::BigFile(SpanReader &spanReader, File::SIZE &fileSystemSize, File::POINTER_VECTOR::size_type &files, File &file)
+		: header(spanReader, fileSystemSize, fileSystemPosition) {
+		read(spanReader, fileSystemSize, file);
+
+		// the layer resources are read with a stream over the same span, so they cost no system calls either
+		SpanReader::StreamBuffer streamBuffer(spanReader);
+		std::istream inputStream(&streamBuffer);
+		inputStream.exceptions(std::istream::failbit | std::istream::badbit);
+		createLayerMap(inputStream);
+
+		create(files);
+	}
+
 	BigFile::BigFile(std::istream &inputStream)
-		: header(inputStream),
-		directory(inputStream) {
+		: header(inputStream) {
+		// in this case it is the same as not having an owner
+		File::SIZE fileSystemSize = 0;
+		read(inputStream, fileSystemSize, std::nullopt);
 	}
 
-	BigFile::BigFile(std::istream &inputStream, const Path &path, File::POINTER &filePointer)
-		: header(inputStream, filePointer),
-		directory(inputStream, path, filePointer) {
+	BigFile::BigFile(SpanReader &indexReader, File::SIZE &fileSystemSize, File::POINTER_VECTOR::size_type &files) {
+		// the header was already checked when the record was written, and the layers were only needed to
+		// decide the names and types of the files, so only the directories and files are read
+		readIndex(indexReader, fileSystemSize);
+		create(files);
+	}
+
+	BigFile::File::POINTER BigFile::find(const Path &path) {
+		PathEntry::VECTOR_MAP::const_iterator pathEntryVectorMapIterator = pathEntryVectorMap.find(path.fileName);
+
+		if (pathEntryVectorMapIterator == pathEntryVectorMap.end()) {
+			return 0;
+		}
+
+		const PathEntry::VECTOR &PATH_ENTRY_VECTOR = pathEntryVectorMapIterator->second;
+
+		for (
+			PathEntry::VECTOR::const_iterator pathEntryVectorIterator = PATH_ENTRY_VECTOR.begin();
+			pathEntryVectorIterator != PATH_ENTRY_VECTOR.end();
+			pathEntryVectorIterator++
+		) {
+			// is this the file we are looking for?
+			if (isMatch(path, pathEntryVectorIterator->directoryIndex)) {
+				return &fileVector[pathEntryVectorIterator->fileIndex];
+			}
+		}
+		return 0;
 	}
 
 	void BigFile::write(std::ostream &outputStream) const {
 		header.write(outputStream);
-		directory.write(outputStream);
+		write(outputStream, directoryVector.front());
+	}
+
+	void BigFile::writeIndex(std::ostream &outputStream, File::SIZE fileSystemSize) const {
+		writeStream(outputStream, &fileSystemPosition, File::POSITION_SIZE);
+		writeStream(outputStream, &fileSystemSize, File::SIZE_SIZE);
+
+		writeIndexSize(outputStream, directoryVector.size());
+		writeIndexSize(outputStream, fileVector.size());
+
+		for (
+			Directory::VECTOR::const_iterator directoryVectorIterator = directoryVector.begin();
+			directoryVectorIterator != directoryVector.end();
+			directoryVectorIterator++
+		) {
+			directoryVectorIterator->writeIndex(outputStream);
+		}
+
+		for (
+			File::VECTOR::const_iterator fileVectorIterator = fileVector.begin();
+			fileVectorIterator != fileVector.end();
+			fileVectorIterator++
+		) {
+			fileVectorIterator->writeIndex(outputStream);
+		}
 	}
 }
\ No newline at end of file
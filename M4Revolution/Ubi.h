@@ -2,8 +2,12 @@
 #include "shared.h"
 #include "IgnoreCaseComparer.h"
 #include <unordered_set>
+#include <unordered_map>
 #include <map>
 #include <vector>
+#include <string_view>
+#include <initializer_list>
+#include <streambuf>
 
 #define RENAME_ENABLED
 #define LAYERS_ENABLED
@@ -11,15 +15,59 @@
 #define RGBA_ENABLED
 
 namespace Ubi {
+	// reads from a span of memory (such as a mapped file) as an alternative to a stream
+	// every read is bounds checked, and strings may be viewed in place instead of copied
+	class SpanReader {
+		private:
+		const unsigned char* data = 0;
+		size_t size = 0;
+		size_t position = 0;
+
+		public:
+		class ReadPastEnd : public std::invalid_argument {
+			public:
+			ReadPastEnd() noexcept : std::invalid_argument("Span read past end") {
+			}
+		};
+
+		// for the resource readers, which seek around and expect a stream
+		// it has no buffer of its own, so reading from it is just a copy out of the span
+		class StreamBuffer : public std::streambuf {
+			protected:
+			pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which = std::ios_base::in);
+			pos_type seekpos(pos_type pos, std::ios_base::openmode which = std::ios_base::in);
+
+			public:
+			StreamBuffer(const SpanReader &spanReader);
+			StreamBuffer(const StreamBuffer &streamBuffer) = delete;
+			StreamBuffer &operator=(const StreamBuffer &streamBuffer) = delete;
+		};
+
+		SpanReader(const unsigned char* data, size_t size, size_t position = 0);
+		void read(void* buffer, size_t count);
+		const unsigned char* view(size_t count);
+		void seek(size_t position);
+		void skip(size_t count);
+		size_t tell() const;
+		const unsigned char* getData() const;
+		size_t getSize() const;
+	};
+
 	namespace String {
 		typedef uint32_t SIZE;
 		static const size_t SIZE_SIZE = sizeof(SIZE);
 
+		typedef std::vector<std::optional<std::string>> OPTIONAL_VECTOR;
+
+		void swizzle(char* str, size_t size);
 		std::optional<std::string> &swizzle(std::optional<std::string> &encryptedStringOptional);
 		std::optional<std::string> readOptional(std::istream &inputStream, bool &nullTerminator);
 		std::optional<std::string> readOptional(std::istream &inputStream);
+		std::optional<std::string_view> readOptionalView(SpanReader &spanReader, bool &nullTerminator);
+		std::optional<std::string_view> readOptionalView(SpanReader &spanReader);
 		std::optional<std::string> readOptionalEncrypted(std::istream &inputStream);
-		void writeOptional(std::ostream &outputStream, const std::optional<std::string> &strOptional, bool nullTerminator = true);
+		void readOptionalEncrypted(std::istream &inputStream, uint32_t count, OPTIONAL_VECTOR &encryptedStringOptionalVector);
+		void writeOptional(std::ostream &outputStream, const std::optional<std::string_view> &strOptional, bool nullTerminator = true);
 		void writeOptionalEncrypted(std::ostream &outputStream, std::optional<std::string> &strOptional);
 	};
 
@@ -107,7 +155,6 @@ namespace Ubi {
 			};
 
 			typedef std::map<std::string, Layer> LAYER_MAP;
-			typedef std::shared_ptr<LAYER_MAP> LAYER_MAP_POINTER;
 
 			void appendToSliceMap(std::istream &inputStream, std::streamsize size, SLICE_MAP &sliceMap);
 		};
@@ -258,6 +305,16 @@ namespace Ubi {
 	struct BigFile {
 		typedef std::shared_ptr<BigFile> POINTER;
 
+		// the indices in an index record are always this size, regardless of platform
+		typedef uint32_t INDEX_SIZE;
+		static const size_t INDEX_SIZE_SIZE = sizeof(INDEX_SIZE);
+
+		class Invalid : public std::invalid_argument {
+			public:
+			Invalid() noexcept : std::invalid_argument("BigFile invalid") {
+			}
+		};
+
 		struct Path {
 			typedef std::vector<Path> VECTOR;
 			typedef std::vector<std::string> NAME_VECTOR;
@@ -275,11 +332,44 @@ namespace Ubi {
 			Path& create(const std::string &file);
 		};
 
+		// all of the names in a BigFile, allocated from blocks that never move
+		// so the names may be string views into it for as long as the BigFile exists
+		// each name is only kept once, because the same names (like the cube faces) are in many directories
+		class StringTable {
+			private:
+			typedef std::unique_ptr<char[]> BLOCK_POINTER;
+			typedef std::vector<BLOCK_POINTER> BLOCK_POINTER_VECTOR;
+			typedef std::unordered_set<std::string_view> STR_SET;
+
+			static const size_t BLOCK_SIZE_MIN = 0x400;
+			static const size_t BLOCK_SIZE_MAX = 0x10000;
+
+			BLOCK_POINTER_VECTOR blockPointerVector = {};
+			size_t blockSize = 0;
+			char* freePointer = 0;
+			size_t freeSize = 0;
+			STR_SET strSet = {};
+
+			char* allocate(size_t size);
+			void deallocate(char* tableStr, size_t size);
+			std::string_view intern(char* tableStr, size_t size, std::string_view str);
+
+			public:
+			StringTable();
+			StringTable(const StringTable &stringTable) = delete;
+			StringTable &operator=(const StringTable &stringTable) = delete;
+			std::string_view add(std::string_view str);
+			std::string_view add(std::initializer_list<std::string_view> strInitializerList);
+			std::string_view add(std::istream &inputStream, size_t size);
+		};
+
 		struct File {
 			typedef uint32_t SIZE;
-			typedef std::shared_ptr<File> POINTER;
-			typedef std::unordered_set<POINTER> POINTER_SET;
-			typedef std::map<SIZE, POINTER_SET> POINTER_SET_MAP;
+			typedef std::vector<File> VECTOR;
+
+			// files are owned by the fileVector of their BigFile, which doesn't change once it's been read
+			// so they are simply pointed to
+			typedef File* POINTER;
 			typedef std::vector<POINTER> POINTER_VECTOR;
 			typedef std::shared_ptr<POINTER_VECTOR> POINTER_VECTOR_POINTER;
 
@@ -292,7 +382,8 @@ namespace Ubi {
 			};
 
 			// the name in the output file (so example.dds, not example.jpg)
-			std::optional<std::string> nameOptional = std::nullopt;
+			// this is in the string table of the BigFile that owns this file
+			std::optional<std::string_view> nameOptional = std::nullopt;
 
 			// initially the size in the input file, to be potentially overwritten later (if converted)
 			SIZE size = 0;
@@ -306,21 +397,21 @@ namespace Ubi {
 			SIZE padding = 0;
 
 			// used for water slices
-			// if this file is a layer, layerInformationPointer is non-zero and
-			// points to the layer information, and layerMapIterator is an iterator
-			// into the layerMap field of layerInformationPointer (it is never the end of the map)
-			Binary::RLE::LAYER_MAP_POINTER layerMapPointer = 0;
-			Binary::RLE::LAYER_MAP::const_iterator layerMapIterator = {};
+			// if this file is a layer, layerPointer is non-zero and points to
+			// the layer information in the layerMap of the BigFile that owns this file
+			const Binary::RLE::Layer* layerPointer = 0;
 
 			// metadata for conversion
 			TYPE type = TYPE::NONE;
 			//bool greyScale = false;
 			bool rgba = false;
 
-			File(std::istream &inputStream, SIZE &fileSystemSize, const std::optional<File> &layerFileOptional);
-			File(std::istream &inputStream);
+			File(std::istream &inputStream, StringTable &stringTable, SIZE &fileSystemSize, const std::optional<File> &layerFileOptional);
+			File(SpanReader &spanReader, StringTable &stringTable, SIZE &fileSystemSize, const std::optional<File> &layerFileOptional);
+			File(SpanReader &indexReader, StringTable &stringTable);
 			File(SIZE inputFileSize);
 			void write(std::ostream &outputStream) const;
+			void writeIndex(std::ostream &outputStream) const;
 
 			Binary::Resource::POINTER appendToLayerMap(
 				std::istream &inputStream,
@@ -335,10 +426,13 @@ namespace Ubi {
 			) const;
 
 			private:
-			void read(std::istream &inputStream);
-			void rename(const std::optional<File> &layerFileOptional);
+			void create(StringTable &stringTable, SIZE &fileSystemSize, const std::optional<File> &layerFileOptional);
+			void read(std::istream &inputStream, StringTable &stringTable);
+			void read(SpanReader &spanReader, StringTable &stringTable);
+			void readIndex(SpanReader &indexReader, StringTable &stringTable);
+			void rename(StringTable &stringTable, const std::optional<File> &layerFileOptional);
 
-			static std::string getNameExtension(const std::string &name);
+			static std::string getNameExtension(std::string_view name);
 			static bool isWaterSlice(const std::string &name, const Binary::RLE::MASK_MAP &waterMaskMap);
 
 			struct TypeExtension {
@@ -352,6 +446,8 @@ namespace Ubi {
 			static const char PERIOD = '.';
 		};
 
+		// directories are rows in the directoryVector of their BigFile
+		// instead of owning the directories and files in them, they refer to them by index
 		struct Directory {
 			typedef std::vector<Directory> VECTOR;
 			typedef std::vector<VECTOR::const_iterator> VECTOR_ITERATOR_VECTOR;
@@ -364,74 +460,27 @@ namespace Ubi {
 			static const std::string NAME_CUBE;
 			static const std::string NAME_WATER;
 
-			std::optional<std::string> nameOptional = std::nullopt;
+			std::optional<std::string_view> nameOptional = std::nullopt;
+
+			// the directory that owns this directory (the root directory has no owner)
+			std::optional<VECTOR::size_type> ownerIndexOptional = std::nullopt;
 
-			// the directories that this directory owns
+			// the directories that this directory owns, which are next to each other in the directoryVector
 			static const size_t DIRECTORY_VECTOR_SIZE_SIZE = sizeof(DIRECTORY_VECTOR_SIZE);
-			Directory::VECTOR directoryVector = {};
+			VECTOR::size_type directoriesBegin = 0;
+			VECTOR::size_type directoriesEnd = 0;
 
-			// the files that this directory owns
-			// binaryFilePointerVector is seperate so we can easily loop just the Binary files
+			// the files that this directory owns, which are next to each other in the fileVector
+			// the Binary files are after the rest so we can easily loop just the Binary files
 			// (this is useful for finding Water/Cube binary files)
 			static const size_t FILE_POINTER_VECTOR_SIZE_SIZE = sizeof(FILE_POINTER_VECTOR_SIZE);
-			File::POINTER_VECTOR binaryFilePointerVector = {};
-			File::POINTER_VECTOR filePointerVector = {};
+			File::VECTOR::size_type filesBegin = 0;
+			File::VECTOR::size_type binaryFilesBegin = 0;
+			File::VECTOR::size_type filesEnd = 0;
 
-			Directory(
-				Directory* ownerDirectory,
-				std::istream &inputStream,
-				File::SIZE &fileSystemSize,
-				File::POINTER_VECTOR::size_type &files,
-				File::POINTER_SET_MAP &filePointerSetMap,
-				const std::optional<File> &layerFileOptional
-			);
-			
-			Directory(std::istream &inputStream);
-			Directory(std::istream &inputStream, const Path &path, File::POINTER &filePointer);
-			Directory(std::istream &inputStream, const Path &path, Path::NAME_VECTOR::const_iterator directoryNameVectorIterator, File::POINTER &filePointer);
-			void write(std::ostream &outputStream) const;
-			File::POINTER find(const Path &path) const;
-
-			void appendToLayerMap(
-				std::istream &inputStream,
-				File::SIZE fileSystemPosition,
-				Binary::RLE::LAYER_MAP &layerMap
-			) const;
-
-			void appendToTextureBoxMap(
-				std::istream &inputStream,
-				File::SIZE fileSystemPosition,
-				Binary::RLE::TEXTURE_BOX_MAP &textureBoxMap
-			) const;
-
-			private:
-			void read(
-				bool owner,
-				std::istream &inputStream,
-				File::SIZE &fileSystemSize,
-				File::POINTER_VECTOR::size_type &files,
-				File::POINTER_SET_MAP &filePointerSetMap,
-				const std::optional<File> &layerFileOptional
-			);
-
-			void find(std::istream &inputStream, const Path &path, Path::NAME_VECTOR::const_iterator directoryNameVectorIterator, File::POINTER &filePointer);
-			File::POINTER find(const Path &path, Path::NAME_VECTOR::const_iterator directoryNameVectorIterator) const;
-			bool isMatch(const Path::NAME_VECTOR &directoryNameVector, Path::NAME_VECTOR::const_iterator &directoryNameVectorIterator) const;
 			bool isSet(bool bftex, const std::optional<File> &layerFileOptional) const;
-
-			void appendToLayerMap(
-				std::istream &inputStream,
-				File::SIZE fileSystemPosition,
-				Binary::RLE::LAYER_MAP &layerMap,
-				const File::POINTER_VECTOR &binaryFilePointerVector
-			) const;
-
-			void appendToTextureBoxMap(
-				std::istream &inputStream,
-				File::SIZE fileSystemPosition,
-				Binary::RLE::TEXTURE_BOX_MAP &textureBoxMap,
-				const File::POINTER_VECTOR &binaryFilePointerVector
-			) const;
+			void writeIndex(std::ostream &outputStream) const;
+			void readIndex(SpanReader &indexReader, StringTable &stringTable);
 		};
 
 		struct Header {
@@ -447,28 +496,146 @@ namespace Ubi {
 
 			Header(std::istream &inputStream, File::SIZE &fileSystemSize, File::SIZE &fileSystemPosition);
 			Header(std::istream &inputStream);
-			Header(std::istream &inputStream, File::POINTER &filePointer);
+			Header(SpanReader &spanReader, File::SIZE &fileSystemSize, File::SIZE &fileSystemPosition);
+			Header(SpanReader &spanReader);
+			Header();
 			void write(std::ostream &outputStream) const;
 
 			private:
+			void create(File::SIZE &fileSystemSize);
 			void read(std::istream &inputStream);
+			void read(SpanReader &spanReader);
 
 			static const std::string SIGNATURE;
 			static const VERSION CURRENT_VERSION = 1;
 		};
 
+		// the files of a BigFile in order of their position, so they can be copied beginning to end
+		// identical files with different paths are at the same position, next to each other
+		// (in the same order they are in the fileVector, so the order never changes between runs)
+		struct Position {
+			typedef std::vector<Position> VECTOR;
+
+			// a BigFile can't have more files than it has bytes, so this is the same size as the position
+			typedef uint32_t FILE_INDEX;
+
+			File::SIZE position = 0;
+			FILE_INDEX fileIndex = 0;
+		};
+
+		// reads the directories of a BigFile one record at a time, without keeping them
+		// this is for when only one file is needed, so the rest don't have to be read into objects
+		// (the names are views of a buffer that is reused, so they only last until the next record)
+		class Cursor {
+			public:
+			enum struct TYPE {
+				DIRECTORY,
+				FILE
+			};
+
+			struct Record {
+				TYPE type = TYPE::DIRECTORY;
+				std::optional<std::string_view> nameOptional = std::nullopt;
+
+				// only for files
+				File::SIZE size = 0;
+				File::SIZE position = 0;
+			};
+
+			// the input stream must be just after the header
+			Cursor(std::istream &inputStream);
+			Cursor(const Cursor &cursor) = delete;
+			Cursor &operator=(const Cursor &cursor) = delete;
+			bool next();
+			void skip();
+			const Record &get() const;
+			size_t getDepth() const;
+
+			private:
+			// the directories the cursor is in, the root directory first
+			struct Frame {
+				typedef std::vector<Frame> VECTOR;
+
+				Directory::DIRECTORY_VECTOR_SIZE directories = 0;
+				std::optional<Directory::FILE_POINTER_VECTOR_SIZE> filesOptional = std::nullopt;
+			};
+
+			std::istream &inputStream;
+			Frame::VECTOR frameVector = {};
+			Record record = {};
+			std::string name = "";
+			bool begun = false;
+
+			bool step();
+			void readDirectory();
+			std::optional<std::string_view> readNameOptional();
+		};
+
 		private:
+		// the files that aren't Binary files by name, so that finding one doesn't mean searching every directory
+		// a name may be in many directories, so the directory is kept to check the rest of the path against
+		// (they are in the same order as they would be found in by searching the directories)
+		struct PathEntry {
+			typedef std::vector<PathEntry> VECTOR;
+			typedef std::unordered_map<std::string_view, VECTOR> VECTOR_MAP;
+
+			Directory::VECTOR::size_type directoryIndex = 0;
+			File::VECTOR::size_type fileIndex = 0;
+		};
+
 		File::SIZE fileSystemPosition = 0;
+		StringTable stringTable;
+		Binary::RLE::LAYER_MAP layerMap = {};
+		PathEntry::VECTOR_MAP pathEntryVectorMap = {};
+
+		// Reader is either a std::istream or a SpanReader
+		template <typename Reader>
+		void read(Reader &reader, File::SIZE &fileSystemSize, const std::optional<File> &layerFileOptional);
+
+		template <typename Reader>
+		void readDirectory(
+			Directory::VECTOR::size_type directoryIndex,
+			Reader &reader,
+			File::SIZE &fileSystemSize,
+			const std::optional<File> &layerFileOptional
+		);
+
+		void readIndex(SpanReader &indexReader, File::SIZE &fileSystemSize);
+		void createPathEntryVectorMap();
+		void create(File::POINTER_VECTOR::size_type &files);
+		void sortPositionVector();
+		void createLayerMap(std::istream &inputStream);
+		void write(std::ostream &outputStream, const Directory &directory) const;
+		bool isMatch(const Path &path, Directory::VECTOR::size_type directoryIndex) const;
+		void appendToLayerMap(std::istream &inputStream, const Directory &directory);
+		void appendToLayerMap(std::istream &inputStream, File::VECTOR::size_type binaryFilesBegin, File::VECTOR::size_type binaryFilesEnd);
+		void appendToTextureBoxMap(std::istream &inputStream, const Directory &directory, Binary::RLE::TEXTURE_BOX_MAP &textureBoxMap) const;
+		void appendToTextureBoxMap(std::istream &inputStream, File::VECTOR::size_type binaryFilesBegin, File::VECTOR::size_type binaryFilesEnd, Binary::RLE::TEXTURE_BOX_MAP &textureBoxMap) const;
+
+		static bool find(std::istream &inputStream, const Path &path, std::optional<File> &fileOptional);
 
 		public:
-		static File::POINTER findFile(std::istream &stream, const Path::VECTOR &pathVector);
+		// the returned file has no name, only a size and position
+		static File findFile(std::istream &stream, const Path::VECTOR &pathVector);
 
 		Header header;
-		Directory directory;
 
-		BigFile(std::istream &inputStream, File::SIZE &fileSystemSize, File::POINTER_VECTOR::size_type &files, File::POINTER_SET_MAP &filePointerSetMap, File &file);
+		// every file and directory in this BigFile, the first directory is the root directory
+		File::VECTOR fileVector = {};
+		Directory::VECTOR directoryVector = {};
+		Position::VECTOR positionVector = {};
+
+		BigFile(std::istream &inputStream, File::SIZE &fileSystemSize, File::POINTER_VECTOR::size_type &files, File &file);
+		BigFile(SpanReader &spanReader, File::SIZE &fileSystemSize, File::POINTER_VECTOR::size_type &files, File &file);
 		BigFile(std::istream &inputStream);
-		BigFile(std::istream &inputStream, const Path &path, File::POINTER &filePointer);
+
+		// loads a record written by writeIndex, which has the names and types of the files already resolved
+		BigFile(SpanReader &indexReader, File::SIZE &fileSystemSize, File::POINTER_VECTOR::size_type &files);
+
+		BigFile(const BigFile &bigFile) = delete;
+		BigFile &operator=(const BigFile &bigFile) = delete;
+		File::POINTER find(const Path &path);
 		void write(std::ostream &outputStream) const;
+		void writeIndex(std::ostream &outputStream, File::SIZE fileSystemSize) const;
 	};
 };
\ No newline at end of file
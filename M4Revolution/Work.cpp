@@ -1,5 +1,22 @@
 #include "Work.h"
 #include <stdio.h>
+#include <sstream>
+#include <iomanip>
+
+#ifdef MACINTOSH
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef LINUX
+#include <sys/sendfile.h>
+#endif
+
+#ifdef IO_URING
+#include <sys/syscall.h>
+#endif
 
 namespace Work {
 	// acquire lock to prevent data race on predicate
@@ -19,276 +36,2693 @@ namespace Work {
 		}
 	}
 
-	Event::Event(bool set) {
-		setPredicate(set);
+	Event::Event(bool set) {
+		setPredicate(set);
+	}
+
+	// the point of this method is to make it so that
+	// one thread will wait until another is doing work
+	// then, continue waiting while it does that work
+	// and then, finally, immediately wake up only once it is done that work
+	// that way we do not have to sleep in a loop
+	// however, in order to prevent busy waiting
+	// the waiting thread must "yield" to other threads
+	// meaning, it won't wake up more than once in a row
+	// if no work is currently happening
+	void Event::wait(bool &yield, bool reset) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		conditionVariable.wait(lock, [&] {
+			// prevent spurious wakeup
+			// if we are yielding, we don't allow waking up until some other thread than us is the one that has set the event
+			// otherwise, all that matters is that the event was in fact set (i.e., the owning lock isn't currently in use by anyone)
+			if (threadIDOptional.has_value() && (!yield || threadIDOptional != std::this_thread::get_id())) {
+				// reset the event if desired (this is run while the lock is held, so is safe)
+				if (reset) {
+					// if the event is reset
+					// then that should cause this to wait (return false)
+					threadIDOptional = std::nullopt;
+				}
+				return true;
+			}
+			return false;
+		});
+	}
+
+	void Event::wait(bool reset) {
+		bool yield = false;
+		wait(yield, reset);
+	}
+
+	// wake up the next thread
+	void Event::set() {
+		setPredicate(true);
+		conditionVariable.notify_one();
+	}
+
+	void Event::reset() {
+		setPredicate(false);
+	}
+
+	Gate::Gate() {
+	}
+
+	void Gate::setMax(size_t maxEntered) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			this->maxEntered = maxEntered ? maxEntered : 1;
+		}
+
+		// if it went up, then whoever is waiting might be let through now
+		conditionVariable.notify_all();
+	}
+
+	// whoever might be able to make room (without entering themselves) can be signalled when someone has to wait
+	void Gate::setWaitingSignal(Signal &waitingSignal) {
+		std::lock_guard<std::mutex> lock(mutex);
+		waitingSignalPointer = &waitingSignal;
+	}
+
+	void Gate::enter(size_t count) {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		if (entered && entered + count > maxEntered) {
+			waiting++;
+
+			if (waitingSignalPointer) {
+				waitingSignalPointer->notify();
+			}
+
+			conditionVariable.wait(lock, [&] {
+				return !entered || entered + count <= maxEntered;
+			});
+
+			waiting--;
+		}
+
+		entered += count;
+	}
+
+	// for threads that must not wait, because the ones that would let them through could be waiting on them
+	// it still counts, so whoever does wait will wait longer
+	void Gate::add(size_t count) {
+		std::lock_guard<std::mutex> lock(mutex);
+		entered += count;
+	}
+
+	void Gate::leave(size_t count) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			entered -= count;
+		}
+
+		conditionVariable.notify_all();
+	}
+
+	// enters only if there's room right now, instead of waiting for there to be
+	bool Gate::tryEnter(size_t count) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (entered + count > maxEntered) {
+			return false;
+		}
+
+		entered += count;
+		return true;
+	}
+
+	// whether anyone is waiting to enter, because there isn't room for them
+	bool Gate::full() {
+		std::lock_guard<std::mutex> lock(mutex);
+		return waiting;
+	}
+
+	Signal::Signal() {
+	}
+
+	Signal::COUNT Signal::get() {
+		return signalled;
+	}
+
+	void Signal::wait(COUNT count) {
+		// this must be counted before looking again, so that either we see the signal
+		// or whoever signals sees that we're about to wait, and wakes us up
+		waiting++;
+		signalled.wait(count);
+		waiting.fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	void Signal::notify() {
+		signalled++;
+
+		if (waiting) {
+			signalled.notify_all();
+		}
+	}
+
+	void Pool::workThread(Pool &pool, unsigned int index) {
+		Work work = {};
+
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(pool.mutex);
+
+				pool.conditionVariable.wait(lock, [&] {
+					return pool.stop || pool.works;
+				});
+
+				// any work that was already submitted is still done before stopping
+				if (!pool.works) {
+					break;
+				}
+
+				pool.works--;
+			}
+
+			// the work was claimed under the lock, so one of the queues is sure to have it for us
+			while (!pool.pop(index, work));
+
+			work.workCallback(work.parameter);
+		}
+	}
+
+	void Pool::destroy() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+
+		conditionVariable.notify_all();
+
+		for (
+			std::vector<std::thread>::iterator threadVectorIterator = threadVector.begin();
+			threadVectorIterator != threadVector.end();
+			threadVectorIterator++
+		) {
+			if (threadVectorIterator->joinable()) {
+				threadVectorIterator->join();
+			}
+		}
+	}
+
+	bool Pool::pop(unsigned int index, Work &work) {
+		Queue* oldestQueuePointer = 0;
+		SEQUENCE oldestSequence = 0;
+
+		for (;;) {
+			oldestQueuePointer = 0;
+
+			// each queue is in the order it was submitted to, so the oldest work is at the front of one of them
+			for (unsigned int i = 0; i < threads; i++) {
+				Queue &queue = queues[(index + i) % threads];
+				std::lock_guard<std::mutex> lock(queue.mutex);
+
+				if (!queue.workDeque.empty() && (!oldestQueuePointer || queue.workDeque.front().sequence < oldestSequence)) {
+					oldestQueuePointer = &queue;
+					oldestSequence = queue.workDeque.front().sequence;
+				}
+			}
+
+			if (!oldestQueuePointer) {
+				return false;
+			}
+
+			// another thread may have taken it in the meantime, in which case we look again
+			Queue &queue = *oldestQueuePointer;
+			std::lock_guard<std::mutex> lock(queue.mutex);
+
+			if (!queue.workDeque.empty() && queue.workDeque.front().sequence == oldestSequence) {
+				work = queue.workDeque.front();
+				queue.workDeque.pop_front();
+				return true;
+			}
+		}
+	}
+
+	Pool::Pool(unsigned int threads)
+		: threads(threads ? threads : 1) {
+		queues = std::unique_ptr<Queue[]>(new Queue[this->threads]);
+
+		MAKE_SCOPE_EXIT(destroyScopeExit) {
+			destroy();
+		};
+
+		for (unsigned int i = 0; i < this->threads; i++) {
+			threadVector.emplace_back(workThread, std::ref(*this), i);
+		}
+
+		destroyScopeExit.dismiss();
+	}
+
+	Pool::~Pool() {
+		destroy();
+	}
+
+	void Pool::submit(WorkCallback workCallback, void* parameter) {
+		{
+			SEQUENCE sequence = this->sequence++;
+
+			Queue &queue = queues[sequence % threads];
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			queue.workDeque.push_back({ workCallback, parameter, sequence });
+		}
+
+		// only counted once it's in a queue, so that a thread claiming it can always find it
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			works++;
+		}
+
+		conditionVariable.notify_one();
+	}
+
+	Data::Data() {
+	}
+
+	Data::Data(size_t size, POINTER pointer)
+		: size(size),
+		pointer(std::move(pointer)) {
+	}
+
+	// instead of being freed, the slab goes back to be allocated again
+	void Data::SlabDeleter::operator()(unsigned char* slab) const {
+		std::lock_guard<std::mutex> lock(slabMutex);
+
+		try {
+			slabVector.push_back(slab);
+		} catch (...) {
+			// if it can't be kept, it's just freed instead
+			delete[] slab;
+		}
+	}
+
+	Data::POINTER Data::allocateSlab() {
+		{
+			std::lock_guard<std::mutex> lock(slabMutex);
+
+			if (!slabVector.empty()) {
+				POINTER pointer(slabVector.back());
+				slabVector.pop_back();
+				return pointer;
+			}
+		}
+
+		const size_t SLAB_SIZE = Data::SLAB_SIZE;
+		return POINTER(new unsigned char[SLAB_SIZE]);
+	}
+
+	// frees the slabs that are kept, for once there's no more data for a while
+	void Data::releaseSlabs() {
+		std::lock_guard<std::mutex> lock(slabMutex);
+
+		for (
+			std::vector<unsigned char*>::iterator slabVectorIterator = slabVector.begin();
+			slabVectorIterator != slabVector.end();
+			slabVectorIterator++
+		) {
+			delete[] *slabVectorIterator;
+		}
+
+		slabVector = {};
+	}
+
+	std::mutex Data::slabMutex = {};
+	std::vector<unsigned char*> Data::slabVector = {};
+
+	Index::Plans::Plans(const MappedFile &mappedFile, Ubi::BigFile::File &file, uint32_t maxThreads)
+		: data(mappedFile.getData()),
+		size(mappedFile.getSize()) {
+		// the top BigFile is the only one not found by reading another BigFile
+		Plan::POINTER planPointer = std::make_shared<Plan>();
+		planPointer->fileOptional = file;
+		planPointerMap.insert({ 0, planPointer });
+		positionSet.insert(0);
+
+		MAKE_SCOPE_EXIT(destroyScopeExit) {
+			destroy();
+		};
+
+		// there is always at least the one thread, or the plans would never be read
+		if (!maxThreads) {
+			maxThreads = 1;
+		}
+
+		for (uint32_t i = 0; i < maxThreads; i++) {
+			threadVector.emplace_back(readThread, std::ref(*this));
+		}
+
+		destroyScopeExit.dismiss();
+	}
+
+	Index::Plans::~Plans() {
+		destroy();
+	}
+
+	const Index::Plans::Plan::POINTER_MAP &Index::Plans::wait() {
+		std::unique_lock<std::mutex> lock(mutex);
+
+		conditionVariable.wait(lock, [&] {
+			return positionSet.empty() && !reading;
+		});
+
+		// if any of them failed to be read, then so does the whole index
+		for (
+			Plan::POINTER_MAP::const_iterator planPointerMapIterator = planPointerMap.begin();
+			planPointerMapIterator != planPointerMap.end();
+			planPointerMapIterator++
+		) {
+			const std::exception_ptr &EXCEPTION_POINTER = planPointerMapIterator->second->exceptionPointer;
+
+			if (EXCEPTION_POINTER) {
+				std::rethrow_exception(EXCEPTION_POINTER);
+			}
+		}
+		return planPointerMap;
+	}
+
+	void Index::Plans::readThread(Plans &plans) {
+		Plan::POINTER_MAP planPointerMap = {};
+		std::streampos bigFileInputPosition = 0;
+		Plan::POINTER planPointer = 0;
+
+		std::unique_lock<std::mutex> lock(plans.mutex);
+
+		for (;;) {
+			plans.conditionVariable.wait(lock, [&] {
+				return plans.stop || !plans.positionSet.empty();
+			});
+
+			if (plans.stop) {
+				break;
+			}
+
+			POSITION_SET::iterator positionSetIterator = plans.positionSet.begin();
+			bigFileInputPosition = *positionSetIterator;
+			plans.positionSet.erase(positionSetIterator);
+
+			planPointer = plans.planPointerMap[bigFileInputPosition];
+			plans.reading++;
+
+			// the BigFile is read without the lock, that's the point
+			lock.unlock();
+			plans.read(bigFileInputPosition, *planPointer, planPointerMap);
+			lock.lock();
+
+			plans.reading--;
+
+			// files at the same position are the same BigFile, so it only needs to be read once
+			for (
+				Plan::POINTER_MAP::iterator planPointerMapIterator = planPointerMap.begin();
+				planPointerMapIterator != planPointerMap.end();
+				planPointerMapIterator++
+			) {
+				if (plans.planPointerMap.insert(*planPointerMapIterator).second) {
+					plans.positionSet.insert(planPointerMapIterator->first);
+				}
+			}
+
+			planPointerMap.clear();
+			plans.conditionVariable.notify_all();
+		}
+	}
+
+	void Index::Plans::destroy() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stop = true;
+		}
+
+		conditionVariable.notify_all();
+
+		for (
+			std::vector<std::thread>::iterator threadVectorIterator = threadVector.begin();
+			threadVectorIterator != threadVector.end();
+			threadVectorIterator++
+		) {
+			if (threadVectorIterator->joinable()) {
+				threadVectorIterator->join();
+			}
+		}
+	}
+
+	void Index::Plans::read(std::streampos bigFileInputPosition, Plan &plan, Plan::POINTER_MAP &planPointerMap) const {
+		// this is read the same way as in fixLoading, so the names and types of the files will be the same
+		try {
+			Ubi::SpanReader spanReader(data, size, (size_t)bigFileInputPosition);
+
+			Ubi::BigFile::File::SIZE fileSystemSize = 0;
+			Ubi::BigFile::File::POINTER_VECTOR::size_type files = 0;
+			Ubi::BigFile::POINTER bigFilePointer = std::make_shared<Ubi::BigFile>(spanReader, fileSystemSize, files, plan.fileOptional.value());
+
+			plan.directoryEndPosition = spanReader.tell();
+
+			std::ostringstream recordStream(std::ios::binary);
+			bigFilePointer->writeIndex(recordStream, fileSystemSize);
+			plan.record = recordStream.str();
+
+			for (
+				Ubi::BigFile::File::VECTOR::const_iterator fileVectorIterator = bigFilePointer->fileVector.begin();
+				fileVectorIterator != bigFilePointer->fileVector.end();
+				fileVectorIterator++
+			) {
+				const Ubi::BigFile::File &BIG_FILE_FILE = *fileVectorIterator;
+
+				if (BIG_FILE_FILE.type != Ubi::BigFile::File::TYPE::BIG_FILE) {
+					continue;
+				}
+
+				Plan::POINTER filePlanPointer = std::make_shared<Plan>();
+				filePlanPointer->ownerBigFilePointer = bigFilePointer;
+				filePlanPointer->fileOptional = BIG_FILE_FILE;
+				planPointerMap.insert({ (std::streampos)BIG_FILE_FILE.position + bigFileInputPosition, filePlanPointer });
+			}
+		} catch (...) {
+			plan.exceptionPointer = std::current_exception();
+		}
+
+		// now that it's been read, the file that owned it isn't needed anymore
+		plan.fileOptional = std::nullopt;
+		plan.ownerBigFilePointer = 0;
+	}
+
+	Index::Key::Key(std::istream &inputStream, const std::filesystem::path &path)
+		: lastWriteTime(std::filesystem::last_write_time(path).time_since_epoch().count()) {
+		inputStream.seekg(0, std::ios::end);
+		size = (uint64_t)inputStream.tellg();
+
+		// FNV-1a over samples spread evenly from the beginning to the end of the file
+		// this is only meant to catch changes that the size and last write time would miss
+		const uint64_t FNV_OFFSET_BASIS = 0xCBF29CE484222325;
+		const uint64_t FNV_PRIME = 0x00000100000001B3;
+
+		std::unique_ptr<unsigned char[]> samplePointer(new unsigned char[SAMPLE_SIZE]);
+		unsigned char* sample = samplePointer.get();
+
+		uint64_t position = 0;
+		uint64_t sampleSize = 0;
+
+		hash = FNV_OFFSET_BASIS;
+
+		for (size_t i = 0; i < SAMPLES; i++) {
+			position = size > SAMPLE_SIZE ? (size - SAMPLE_SIZE) * i / (SAMPLES - 1) : 0;
+			sampleSize = size - position < SAMPLE_SIZE ? size - position : SAMPLE_SIZE;
+
+			inputStream.seekg(position);
+			readStream(inputStream, sample, sampleSize);
+
+			for (uint64_t j = 0; j < sampleSize; j++) {
+				hash ^= sample[j];
+				hash *= FNV_PRIME;
+			}
+		}
+	}
+
+	void Index::Key::write(std::ostream &outputStream) const {
+		writeStream(outputStream, &size, sizeof(size));
+		writeStream(outputStream, &lastWriteTime, sizeof(lastWriteTime));
+		writeStream(outputStream, &hash, sizeof(hash));
+	}
+
+	bool Index::Key::read(Ubi::SpanReader &indexReader) const {
+		uint64_t indexSize = 0;
+		int64_t indexLastWriteTime = 0;
+		uint64_t indexHash = 0;
+
+		indexReader.read(&indexSize, sizeof(indexSize));
+		indexReader.read(&indexLastWriteTime, sizeof(indexLastWriteTime));
+		indexReader.read(&indexHash, sizeof(indexHash));
+
+		return indexSize == size
+			&& indexLastWriteTime == lastWriteTime
+			&& indexHash == hash;
+	}
+
+	void Index::load(const Key &key) {
+		entryMap.clear();
+
+		Ubi::SpanReader indexReader((const unsigned char*)index.data(), index.size());
+
+		if (Ubi::String::readOptionalView(indexReader) != SIGNATURE) {
+			throw Invalid();
+		}
+
+		VERSION version = 0;
+		indexReader.read(&version, sizeof(version));
+
+		if (version != CURRENT_VERSION) {
+			throw Invalid();
+		}
+
+		// the index is out of date
+		if (!key.read(indexReader)) {
+			throw Invalid();
+		}
+
+		ENTRY_MAP_SIZE entries = 0;
+		indexReader.read(&entries, sizeof(entries));
+
+		POSITION bigFileInputPosition = 0;
+		POSITION directoryEndPosition = 0;
+		POSITION recordSize = 0;
+
+		for (ENTRY_MAP_SIZE i = 0; i < entries; i++) {
+			indexReader.read(&bigFileInputPosition, sizeof(bigFileInputPosition));
+			indexReader.read(&directoryEndPosition, sizeof(directoryEndPosition));
+			indexReader.read(&recordSize, sizeof(recordSize));
+
+			if (recordSize > index.size()) {
+				throw Invalid();
+			}
+
+			Entry entry = {};
+			entry.directoryEndPosition = (std::streampos)directoryEndPosition;
+			entry.recordPosition = indexReader.tell();
+			entry.recordSize = (size_t)recordSize;
+
+			indexReader.skip(entry.recordSize);
+			entryMap.insert({ (std::streampos)bigFileInputPosition, entry });
+		}
+	}
+
+	void Index::create(const Key &key, ENTRY_MAP_SIZE entries, const std::string &entriesString) {
+		std::ostringstream indexStream(std::ios::binary);
+		Ubi::String::writeOptional(indexStream, SIGNATURE);
+
+		VERSION version = CURRENT_VERSION;
+		writeStream(indexStream, &version, sizeof(version));
+
+		key.write(indexStream);
+		writeStream(indexStream, &entries, sizeof(entries));
+		writeStream(indexStream, entriesString.data(), entriesString.size());
+
+		index = indexStream.str();
+	}
+
+	void Index::create(std::istream &inputStream, const Key &key) {
+		std::ostringstream entriesStream(std::ios::binary);
+		ENTRY_MAP_SIZE entries = 0;
+
+		// like the top BigFile in fixLoading, it is owned by a file that is the entire input file
+		Ubi::BigFile::File file((Ubi::BigFile::File::SIZE)key.size);
+		POSITION_SET bigFileInputPositionSet = { 0 };
+
+		inputStream.seekg(0);
+		create(inputStream, file, entriesStream, entries, bigFileInputPositionSet);
+		create(key, entries, entriesStream.str());
+	}
+
+	void Index::create(const MappedFile &mappedFile, const Key &key, uint32_t maxThreads) {
+		Ubi::BigFile::File file((Ubi::BigFile::File::SIZE)key.size);
+		Plans plans(mappedFile, file, maxThreads);
+
+		const Plans::Plan::POINTER_MAP &PLAN_POINTER_MAP = plans.wait();
+
+		std::ostringstream entriesStream(std::ios::binary);
+
+		for (
+			Plans::Plan::POINTER_MAP::const_iterator planPointerMapIterator = PLAN_POINTER_MAP.begin();
+			planPointerMapIterator != PLAN_POINTER_MAP.end();
+			planPointerMapIterator++
+		) {
+			const Plans::Plan &PLAN = *planPointerMapIterator->second;
+			writeEntry(entriesStream, planPointerMapIterator->first, PLAN.directoryEndPosition, PLAN.record);
+		}
+
+		create(key, (ENTRY_MAP_SIZE)PLAN_POINTER_MAP.size(), entriesStream.str());
+	}
+
+	void Index::create(
+		std::istream &inputStream,
+		Ubi::BigFile::File &file,
+		std::ostream &entriesStream,
+		ENTRY_MAP_SIZE &entries,
+		POSITION_SET &bigFileInputPositionSet
+	) {
+		std::streampos bigFileInputPosition = inputStream.tellg();
+
+		// this is read the same way as in fixLoading, so the names and types of the files will be the same
+		Ubi::BigFile::File::SIZE fileSystemSize = 0;
+		Ubi::BigFile::File::POINTER_VECTOR::size_type files = 0;
+		Ubi::BigFile bigFile(inputStream, fileSystemSize, files, file);
+
+		std::ostringstream recordStream(std::ios::binary);
+		bigFile.writeIndex(recordStream, fileSystemSize);
+
+		writeEntry(entriesStream, bigFileInputPosition, inputStream.tellg(), recordStream.str());
+		entries++;
+
+		std::streampos fileInputPosition = 0;
+
+		for (
+			Ubi::BigFile::File::VECTOR::iterator fileVectorIterator = bigFile.fileVector.begin();
+			fileVectorIterator != bigFile.fileVector.end();
+			fileVectorIterator++
+		) {
+			Ubi::BigFile::File &bigFileFile = *fileVectorIterator;
+
+			if (bigFileFile.type != Ubi::BigFile::File::TYPE::BIG_FILE) {
+				continue;
+			}
+
+			// files at the same position are the same BigFile, so it only needs to be indexed once
+			fileInputPosition = (std::streampos)bigFileFile.position + bigFileInputPosition;
+
+			if (!bigFileInputPositionSet.insert(fileInputPosition).second) {
+				continue;
+			}
+
+			inputStream.seekg(fileInputPosition);
+			create(inputStream, bigFileFile, entriesStream, entries, bigFileInputPositionSet);
+		}
+	}
+
+	void Index::writeEntry(
+		std::ostream &entriesStream,
+		std::streampos bigFileInputPosition,
+		std::streampos directoryEndPosition,
+		const std::string &record
+	) {
+		POSITION position = (POSITION)bigFileInputPosition;
+		writeStream(entriesStream, &position, sizeof(position));
+
+		position = (POSITION)directoryEndPosition;
+		writeStream(entriesStream, &position, sizeof(position));
+
+		POSITION recordSize = record.size();
+		writeStream(entriesStream, &recordSize, sizeof(recordSize));
+		writeStream(entriesStream, record.data(), record.size());
+	}
+
+	const std::string Index::SIGNATURE = "M4R_IDX_SIG";
+
+	void Index::open(std::istream &inputStream, const std::filesystem::path &path, const MappedFile* mappedFilePointer, bool create, uint32_t maxThreads) {
+		Key key(inputStream, path);
+		const std::filesystem::path INDEX_PATH = getPath(path);
+
+		try {
+			std::ifstream indexFileStream;
+			indexFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+			indexFileStream.open(INDEX_PATH, std::ios::binary);
+
+			index.resize((std::string::size_type)std::filesystem::file_size(INDEX_PATH));
+			readStream(indexFileStream, index.data(), index.size());
+
+			load(key);
+			return;
+		} catch (std::system_error) {
+			// the index doesn't exist or couldn't be read
+		} catch (std::invalid_argument) {
+			// the index is out of date or corrupt
+		}
+
+		if (!create) {
+			throw Invalid();
+		}
+
+		if (mappedFilePointer) {
+			this->create(*mappedFilePointer, key, maxThreads);
+		} else {
+			this->create(inputStream, key);
+		}
+
+		// the index is written to a temporary file first so that one which was only partially written is never loaded
+		// if it can't be saved at all, it is still used for now, it'll just have to be created again next time
+		std::filesystem::path temporaryPath = INDEX_PATH;
+		temporaryPath += ".tmp";
+
+		try {
+			{
+				std::ofstream indexFileStream;
+				indexFileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+				indexFileStream.open(temporaryPath, std::ios::binary | std::ios::trunc);
+				writeStream(indexFileStream, index.data(), index.size());
+			}
+
+			std::filesystem::rename(temporaryPath, INDEX_PATH);
+		} catch (std::system_error) {
+			std::error_code errorCode = {};
+			std::filesystem::remove(temporaryPath, errorCode);
+		}
+
+		load(key);
+	}
+
+	Index::Index(std::istream &inputStream, const std::filesystem::path &path, const MappedFile* mappedFilePointer, bool create, uint32_t maxThreads) {
+		std::streampos position = inputStream.tellg();
+
+		// the stream is put back where it was, even if the input file turned out to be invalid
+		try {
+			open(inputStream, path, mappedFilePointer, create, maxThreads);
+		} catch (...) {
+			inputStream.clear();
+			inputStream.seekg(position);
+			throw;
+		}
+
+		inputStream.seekg(position);
+	}
+
+	const Index::Entry* Index::find(std::streampos bigFileInputPosition) const {
+		ENTRY_MAP::const_iterator entryMapIterator = entryMap.find(bigFileInputPosition);
+
+		if (entryMapIterator == entryMap.end()) {
+			return 0;
+		}
+		return &entryMapIterator->second;
+	}
+
+	Ubi::SpanReader Index::getRecordReader(const Entry &entry) const {
+		return Ubi::SpanReader((const unsigned char*)index.data() + entry.recordPosition, entry.recordSize);
+	}
+
+	Ubi::BigFile::File Index::findFile(std::istream &inputStream, const Ubi::BigFile::Path::VECTOR &pathVector) const {
+		std::optional<Ubi::BigFile::File> fileOptional = std::nullopt;
+		std::streampos position = 0;
+
+		const Entry* entryPointer = 0;
+		Ubi::BigFile::File::POINTER filePointer = 0;
+
+		for (
+			Ubi::BigFile::Path::VECTOR::const_iterator pathVectorIterator = pathVector.begin();
+			pathVectorIterator != pathVector.end();
+			pathVectorIterator++
+		) {
+			entryPointer = find(position);
+
+			if (!entryPointer) {
+				throw Invalid();
+			}
+
+			Ubi::SpanReader indexReader = getRecordReader(*entryPointer);
+
+			Ubi::BigFile::File::SIZE fileSystemSize = 0;
+			Ubi::BigFile::File::POINTER_VECTOR::size_type files = 0;
+			Ubi::BigFile bigFile(indexReader, fileSystemSize, files);
+
+			// the index only has the names after renaming, so if the file isn't found
+			// the caller may still find it by reading the directories from the input file
+			filePointer = bigFile.find(*pathVectorIterator);
+
+			if (!filePointer) {
+				throw Invalid();
+			}
+
+			fileOptional.emplace(filePointer->size);
+			fileOptional.value().position = filePointer->position;
+			position += (std::streamoff)filePointer->position;
+		}
+
+		if (!fileOptional.has_value()) {
+			throw Invalid();
+		}
+
+		inputStream.seekg(position);
+		return fileOptional.value();
+	}
+
+	void Index::remove(const std::filesystem::path &path) {
+		// if the index can't be removed, it's still safe, as it won't match the file anymore
+		std::error_code errorCode = {};
+		std::filesystem::remove(getPath(path), errorCode);
+	}
+
+	std::filesystem::path Index::getPath(std::filesystem::path path) {
+		return path.replace_extension("idx");
+	}
+
+	BigFileTask::BigFileTask(
+		std::istream &inputStream,
+		const POINTER &ownerBigFileTaskPointer,
+		Ubi::BigFile::File &file
+	)
+		: ownerBigFileTaskPointer(ownerBigFileTaskPointer),
+		file(file),
+		bigFilePointer(std::make_shared<Ubi::BigFile>(inputStream, fileSystemSize, files, file)) {
+	}
+
+	BigFileTask::BigFileTask(
+		Ubi::SpanReader &spanReader,
+		const POINTER &ownerBigFileTaskPointer,
+		Ubi::BigFile::File &file
+	)
+		: ownerBigFileTaskPointer(ownerBigFileTaskPointer),
+		file(file),
+		bigFilePointer(std::make_shared<Ubi::BigFile>(spanReader, fileSystemSize, files, file)) {
+	}
+
+	BigFileTask::BigFileTask(
+		const Index &index,
+		const Index::Entry &entry,
+		const POINTER &ownerBigFileTaskPointer,
+		Ubi::BigFile::File &file
+	)
+		: ownerBigFileTaskPointer(ownerBigFileTaskPointer),
+		file(file) {
+		Ubi::SpanReader indexReader = index.getRecordReader(entry);
+		bigFilePointer = std::make_shared<Ubi::BigFile>(indexReader, fileSystemSize, files);
+	}
+
+	BigFileTask::POINTER BigFileTask::getOwnerBigFileTaskPointer() const {
+		return ownerBigFileTaskPointer;
+	}
+
+	Ubi::BigFile::File &BigFileTask::getFile() const {
+		return file;
+	}
+
+	Ubi::BigFile::File::SIZE BigFileTask::getFileSystemSize() const {
+		return fileSystemSize;
+	}
+
+	Ubi::BigFile::File::POINTER_VECTOR::size_type BigFileTask::getFiles() const {
+		return files;
+	}
+
+	Ubi::BigFile::POINTER BigFileTask::getBigFilePointer() const {
+		return bigFilePointer;
+	}
+
+	FileTask::FileTask(const BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File* filePointer, Signal &outputSignal)
+		: ownerBigFileTaskPointer(ownerBigFileTaskPointer),
+		fileVariant(filePointer),
+		outputSignal(outputSignal) {
+	}
+
+	FileTask::FileTask(const BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File::POINTER_VECTOR_POINTER &filePointerVectorPointer, Signal &outputSignal)
+		: ownerBigFileTaskPointer(ownerBigFileTaskPointer),
+		fileVariant(filePointerVectorPointer),
+		outputSignal(outputSignal) {
+	}
+
+	#ifdef LINUX
+	FileTask::FileTask(const BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File* filePointer, const std::shared_ptr<Segment> &segmentPointer, Signal &outputSignal)
+		: ownerBigFileTaskPointer(ownerBigFileTaskPointer),
+		fileVariant(filePointer),
+		outputSignal(outputSignal),
+		segmentPointer(segmentPointer) {
+	}
+	#endif
+
+	// called to add new data, the output thread is woken up to write it if it's waiting on it
+	// if the output thread hasn't caught up yet and the ring is full, this waits for it
+	void FileTask::emplace(size_t size, Data::POINTER pointer) {
+		const size_t RING_SIZE = FileTask::RING_SIZE;
+
+		size_t index = writeIndex.load(std::memory_order_relaxed);
+
+		if (index - writeReadIndex == RING_SIZE) {
+			writeReadIndex = readIndex.load(std::memory_order_acquire);
+
+			if (index - writeReadIndex == RING_SIZE) {
+				// this must be set before looking again, so that either we see the output thread made room
+				// or it sees that we're about to wait, and wakes us up
+				writing = true;
+				writeReadIndex = readIndex;
+
+				while (index - writeReadIndex == RING_SIZE) {
+					readIndex.wait(writeReadIndex);
+					writeReadIndex = readIndex.load(std::memory_order_acquire);
+				}
+
+				writing.store(false, std::memory_order_relaxed);
+			}
+		}
+
+		ring[index % RING_SIZE] = Data(size, std::move(pointer));
+		writeIndex = index + 1;
+
+		outputSignal.notify();
+	}
+
+	// called by the output thread to take the next data, if there is any yet
+	bool FileTask::tryPop(Data &data) {
+		const size_t RING_SIZE = FileTask::RING_SIZE;
+
+		size_t index = readIndex.load(std::memory_order_relaxed);
+
+		if (index == readWriteIndex) {
+			readWriteIndex = writeIndex.load(std::memory_order_acquire);
+
+			if (index == readWriteIndex) {
+				return false;
+			}
+		}
+
+		// the data is moved out so the ring doesn't keep it alive after it's written
+		data = std::move(ring[index % RING_SIZE]);
+		readIndex = index + 1;
+
+		if (writing) {
+			readIndex.notify_one();
+		}
+		return true;
+	}
+
+	void FileTask::copy(std::istream &inputStream, std::streamsize count, Gate &memoryGate) {
+		if (!count) {
+			return;
+		}
+
+		#ifdef LINUX
+		// if we know how much there is, the output thread copies it straight from the input file instead
+		if (count != -1) {
+			passthroughInputPosition = inputStream.tellg();
+			passthroughCount = count;
+
+			inputStream.seekg(count, std::ios::cur);
+			return;
+		}
+		#endif
+
+		const size_t SLAB_SIZE = Data::SLAB_SIZE;
+
+		std::streamsize countRead = SLAB_SIZE;
+		std::streamsize gcountRead = 0;
+
+		do {
+			countRead = (std::streamsize)__min((size_t)count, (size_t)countRead);
+
+			{
+				// wait for there to be room in the memory budget, the output thread lets it go once it's written
+				memoryGate.enter((size_t)countRead);
+
+				MAKE_SCOPE_EXIT(memoryGateScopeExit) {
+					memoryGate.leave((size_t)countRead);
+				};
+
+				Data::POINTER pointer = Data::allocateSlab();
+
+				readStreamPartial(inputStream, pointer.get(), countRead, gcountRead);
+
+				if (!gcountRead) {
+					break;
+				}
+
+				memoryGateScopeExit.dismiss();
+				memoryGate.leave((size_t)(countRead - gcountRead));
+
+				emplace((size_t)gcountRead, std::move(pointer));
+			}
+
+			if (count != -1) {
+				count -= gcountRead;
+
+				if (!count) {
+					break;
+				}
+			}
+		} while (countRead == gcountRead);
+
+		if (count != -1) {
+			if (count) {
+				throw std::logic_error("count must not be greater than file size");
+			}
+		}
+	}
+
+	// called to signal to the output thread that we are done adding new data
+	void FileTask::complete() {
+		emplace(0, 0);
+	}
+
+	// must be called before any data is added, so that the output thread doesn't start writing it in order first
+	void FileTask::plan(std::streamsize size) {
+		plannedSize = size;
+
+		// the output thread may be waiting on this FileTask, in which case it can place it now
+		outputSignal.notify();
+	}
+
+	std::streamsize FileTask::getPlannedSize() {
+		return plannedSize;
+	}
+
+	// called by the output thread once it has left space for the file, so the rest of the data can be written there directly
+	void FileTask::place(Writer &writer, std::streampos position) {
+		placedWriterPointer = &writer;
+		placedPosition.store(position, std::memory_order_release);
+	}
+
+	// returns null if the FileTask hasn't been placed (yet)
+	Writer* FileTask::getPlacedWriterPointer(std::streampos &position) {
+		std::streamoff placedPosition = this->placedPosition.load(std::memory_order_acquire);
+
+		if (placedPosition == -1) {
+			return 0;
+		}
+
+		position = placedPosition;
+		return placedWriterPointer;
+	}
+
+	#ifdef LINUX
+	// these are only safe to get after complete has been called, which is when the output thread gets to the end of the data
+	std::streampos FileTask::getPassthroughInputPosition() const {
+		return passthroughInputPosition;
+	}
+
+	std::streamsize FileTask::getPassthroughCount() const {
+		return passthroughCount;
+	}
+
+	std::shared_ptr<Segment> FileTask::getSegmentPointer() const {
+		return segmentPointer;
+	}
+	#endif
+
+	BigFileTask::POINTER FileTask::getOwnerBigFileTaskPointer() {
+		return ownerBigFileTaskPointer;
+	}
+
+	FileTask::FILE_VARIANT FileTask::getFileVariant() {
+		return fileVariant;
+	}
+
+	Segment::Segment(const char* fileName, const char* spillFileName)
+		: fileEvent(true),
+		fileName(fileName),
+		spillFileName(spillFileName) {
+	}
+
+	FileTask::POINTER_QUEUE_LOCK Segment::fileLock(bool &yield) {
+		return FileTask::POINTER_QUEUE_LOCK(fileEvent, fileTaskPointerQueue, yield);
+	}
+
+	FileTask::POINTER_QUEUE_LOCK Segment::fileLock() {
+		bool yield = false;
+		return fileLock(yield);
+	}
+
+	const char* Segment::getFileName() const {
+		return fileName.c_str();
+	}
+
+	const char* Segment::getSpillFileName() const {
+		return spillFileName.c_str();
+	}
+
+	Tasks::Tasks()
+		: segment(Journal::OUTPUT_FILE_NAME, Reorder::SPILL_FILE_NAME) {
+		// the output thread may be keeping memory that the reading thread is waiting on
+		memoryGate.setWaitingSignal(outputSignal);
+	}
+
+	Segment &Tasks::getSegment() {
+		return segment;
+	}
+
+	void Tasks::setMaxFileTasks(FileTask::POINTER_QUEUE::size_type maxFileTasks) {
+		fileGate.setMax(maxFileTasks);
+	}
+
+	// called before a FileTask is queued, waits if the output thread has too many already
+	void Tasks::enterFile() {
+		fileGate.enter();
+	}
+
+	// called by the output thread once it's written a FileTask
+	void Tasks::leaveFile() {
+		fileGate.leave();
+	}
+
+	void Tasks::setMemoryBudget(size_t memoryBudget) {
+		// an eighth of the budget is for results kept for duplicates, so that it's never more than the budget altogether
+		const size_t RESULT_BUDGET = memoryBudget / 8;
+
+		resultGate.setMax(RESULT_BUDGET);
+		memoryGate.setMax(memoryBudget - RESULT_BUDGET);
+	}
+
+	Gate &Tasks::getMemoryGate() {
+		return memoryGate;
+	}
+
+	Gate &Tasks::getResultGate() {
+		return resultGate;
+	}
+
+	Signal &Tasks::getOutputSignal() {
+		return outputSignal;
+	}
+
+	void Tasks::setQueueDepth(unsigned int queueDepth) {
+		this->queueDepth = queueDepth;
+	}
+
+	unsigned int Tasks::getQueueDepth() const {
+		return queueDepth;
+	}
+
+	Cache::Entry::Entry(Cache &cache, const std::string &key)
+		: path(cache.getEntryPath(key)) {
+		temporaryPath = path;
+		temporaryPath += "." + std::to_string(cache.temporaryFiles++) + ".tmp";
+
+		// failing to write an entry isn't an error, it just won't be added, so this is checked once it's committed
+		fileStream.open(temporaryPath, std::ios::binary | std::ios::trunc);
+
+		const std::string &HEADER = cache.getHeader(key);
+		write(HEADER.data(), HEADER.size());
+	}
+
+	Cache::Entry::~Entry() {
+		if (temporaryPath.empty()) {
+			return;
+		}
+
+		if (fileStream.is_open()) {
+			fileStream.close();
+		}
+
+		std::error_code errorCode = {};
+		std::filesystem::remove(temporaryPath, errorCode);
+	}
+
+	void Cache::Entry::write(const void* pointer, size_t size) {
+		if (!fileStream) {
+			return;
+		}
+
+		writeStream(fileStream, pointer, size);
+	}
+
+	void Cache::Entry::commit() {
+		if (temporaryPath.empty()) {
+			return;
+		}
+
+		fileStream.close();
+
+		if (!fileStream) {
+			return;
+		}
+
+		std::error_code errorCode = {};
+		std::filesystem::rename(temporaryPath, path, errorCode);
+
+		if (!errorCode) {
+			temporaryPath.clear();
+		}
+	}
+
+	std::string Cache::getHeader(const std::string &key) const {
+		std::ostringstream headerStream(std::ios::binary);
+		Ubi::String::writeOptional(headerStream, SIGNATURE);
+
+		VERSION version = CURRENT_VERSION;
+		writeStream(headerStream, &version, sizeof(version));
+
+		KEY_SIZE keySize = (KEY_SIZE)key.size();
+		writeStream(headerStream, &keySize, sizeof(keySize));
+		writeStream(headerStream, key.data(), key.size());
+		return headerStream.str();
+	}
+
+	std::filesystem::path Cache::getEntryPath(const std::string &key) const {
+		std::ostringstream fileNameStream;
+		fileNameStream.exceptions(std::ostringstream::badbit);
+		fileNameStream << std::hex << std::uppercase << std::setfill('0') << std::setw(16) << hash((const unsigned char*)key.data(), key.size());
+		return path / fileNameStream.str();
+	}
+
+	const std::string Cache::SIGNATURE = "M4R_CCH_SIG";
+
+	Cache::Cache(const std::filesystem::path &path) {
+		std::filesystem::create_directory(path);
+
+		// the entries are kept in a directory for this version of the cache and NVTT
+		{
+			std::ostringstream versionStream;
+			versionStream.exceptions(std::ostringstream::badbit);
+			versionStream << std::hex << std::uppercase << std::setfill('0') << std::setw(8) << CURRENT_VERSION << std::setw(8) << nvtt::version();
+			this->path = path / versionStream.str();
+		}
+
+		// no other version would ever find its entries again, so they're thrown out instead of piling up
+		std::error_code errorCode = {};
+
+		for (
+			std::filesystem::directory_iterator directoryIterator(path, errorCode);
+			!errorCode && directoryIterator != std::filesystem::directory_iterator();
+			directoryIterator.increment(errorCode)
+		) {
+			const std::filesystem::path &VERSION_PATH = directoryIterator->path();
+
+			if (VERSION_PATH != this->path) {
+				std::error_code removeErrorCode = {};
+				std::filesystem::remove_all(VERSION_PATH, removeErrorCode);
+			}
+		}
+
+		std::filesystem::create_directory(this->path);
+
+		// entries that were still being written last time are thrown out
+		errorCode.clear();
+
+		for (
+			std::filesystem::directory_iterator directoryIterator(this->path, errorCode);
+			!errorCode && directoryIterator != std::filesystem::directory_iterator();
+			directoryIterator.increment(errorCode)
+		) {
+			const std::filesystem::path &ENTRY_PATH = directoryIterator->path();
+
+			if (ENTRY_PATH.extension() == ".tmp") {
+				std::error_code removeErrorCode = {};
+				std::filesystem::remove(ENTRY_PATH, removeErrorCode);
+			}
+		}
+	}
+
+	// the key is kept in the entry, so two keys with the same hash can't be mixed up
+	bool Cache::find(const std::string &key, std::string &data) const {
+		const std::filesystem::path ENTRY_PATH = getEntryPath(key);
+		const std::string &HEADER = getHeader(key);
+
+		try {
+			std::ifstream entryFileStream;
+			entryFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+			entryFileStream.open(ENTRY_PATH, std::ios::binary);
+
+			std::uintmax_t size = std::filesystem::file_size(ENTRY_PATH);
+
+			if (size < HEADER.size()) {
+				return false;
+			}
+
+			std::string header(HEADER.size(), 0);
+			readStream(entryFileStream, header.data(), header.size());
+
+			if (header != HEADER) {
+				return false;
+			}
+
+			data.resize((std::string::size_type)(size - HEADER.size()));
+			readStream(entryFileStream, data.data(), data.size());
+		} catch (std::system_error) {
+			// the entry doesn't exist or couldn't be read
+			return false;
+		}
+		return true;
+	}
+
+	Cache::HASH Cache::hash(const unsigned char* data, size_t size) {
+		const HASH FNV_OFFSET_BASIS = 0xCBF29CE484222325;
+		const HASH FNV_PRIME = 0x00000100000001B3;
+
+		HASH result = FNV_OFFSET_BASIS;
+
+		for (size_t i = 0; i < size; i++) {
+			result ^= data[i];
+			result *= FNV_PRIME;
+		}
+		return result;
+	}
+
+	void Cache::remove(const std::filesystem::path &path) {
+		std::error_code errorCode = {};
+		std::filesystem::remove_all(getPath(path), errorCode);
+	}
+
+	std::filesystem::path Cache::getPath(std::filesystem::path path) {
+		return path.replace_extension("cache");
+	}
+
+	Result::Result(Gate &resultGate)
+		: resultGate(resultGate) {
+	}
+
+	Result::~Result() {
+		if (dataPointer) {
+			resultGate.leave(dataPointer->size());
+		}
+	}
+
+	// if the result isn't complete yet, the duplicate is written out once it is, and true is returned
+	// otherwise, the data is what was kept, or null if there wasn't room to keep it (so the duplicate must be converted)
+	bool Result::wait(const Duplicate &duplicate, DATA_POINTER &dataPointer) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		if (!completed) {
+			duplicateVector.push_back(duplicate);
+			return true;
+		}
+
+		dataPointer = this->dataPointer;
+		return false;
+	}
+
+	// returns the duplicates that were waiting, to be written out with the same data
+	Result::Duplicate::VECTOR Result::complete(const DATA_POINTER &dataPointer) {
+		std::lock_guard<std::mutex> lock(mutex);
+
+		completed = true;
+
+		if (resultGate.tryEnter(dataPointer->size())) {
+			this->dataPointer = dataPointer;
+		}
+		return std::move(duplicateVector);
+	}
+
+	Convert::Convert(
+		const Configuration &configuration,
+		const nvtt::Context &context,
+		Ubi::BigFile::File &file,
+		Gate &memoryGate
+	)
+		: CONFIGURATION(configuration),
+		CONTEXT(context),
+		file(file),
+		memoryGate(memoryGate) {
+	}
+
+	Convert::~Convert() {
+		freeData();
+	}
+
+	// this waits for there to be room in the memory budget for the file first
+	void Convert::readData(std::istream &inputStream) {
+		memoryGate.enter(file.size);
+		dataSize = file.size;
+
+		dataPointer = std::unique_ptr<unsigned char[]>(new unsigned char[dataSize]);
+		readStream(inputStream, dataPointer.get(), dataSize);
+	}
+
+	// called as soon as the file data isn't needed anymore, so it stops counting against the memory budget
+	void Convert::freeData() {
+		if (!dataSize) {
+			return;
+		}
+
+		dataPointer = 0;
+		memoryGate.leave(dataSize);
+		dataSize = 0;
+	}
+
+	const char* Output::FILE_NAME = "~M4R.tmp"; // must be an 8.3 filename
+	const char* Output::FILE_RETRY = "The game files could not be accessed. Please ensure the game is not open while using this tool. If this error is occuring and the game is not open, you may be out of disk space, or you may need to run this tool as admin.";
+
+	const Output::INFO_MAP Output::FILE_PATH_INFO_MAP = {
+		{FILE_PATH_DATA, {GAMEDATABINDIR "/data.m4b", true}},
+		{FILE_PATH_USER_PREFERENCE, {EXEDIR "/user.dsc", false}},
+		{FILE_PATH_M4_THOR, {EXEDIR "/m4_thor_rd.dll", true}},
+		{FILE_PATH_M4_AI_GLOBAL, {EXEDIR "/m4_ai_global_rd.dll", true}},
+		{FILE_PATH_GFX_TOOLS, {EXEDIR "/gfx_tools_rd.dll", true}}
+	};
+
+	const std::filesystem::path Output::DATA_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_DATA).path;
+	const std::filesystem::path Output::USER_PREFERENCE_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_USER_PREFERENCE).path;
+	const std::filesystem::path Output::M4_THOR_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_M4_THOR).path;
+	const std::filesystem::path Output::M4_AI_GLOBAL_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_M4_AI_GLOBAL).path;
+	const std::filesystem::path Output::GFX_TOOLS_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_GFX_TOOLS).path;
+
+	void Output::findInstallPath(const std::filesystem::path &path) {
+		bool foundInstalled = setPath(path);
+
+		if (foundInstalled) {
+			consoleLog("An install of Myst IV: Revelation was found at this path:");
+			consoleLog(path.string().c_str(), 2);
+
+			foundInstalled = consoleBool("Is this the path to the install you would like to modify?", true);
+		} else {
+			consoleLog("No install of Myst IV: Relevation was found. ", false);
+		}
+
+		if (!foundInstalled) {
+			while (!setPath(consoleString("Please enter the path to Myst IV: Relevation."))) {
+				consoleLog("No install of Myst IV: Relevation was found at this path. ", false);
+			}
+		}
+	}
+
+	bool Output::setPath(const std::filesystem::path &path) {
+		try {
+			std::filesystem::current_path(path);
+		} catch (std::filesystem::filesystem_error) {
+			return false;
+		}
+
+		for (INFO_MAP::const_iterator infoMapIterator = FILE_PATH_INFO_MAP.begin(); infoMapIterator != FILE_PATH_INFO_MAP.end(); infoMapIterator++) {
+			const Info &INFO = infoMapIterator->second;
+
+			// this check is just to prevent the user from being dumb
+			// we need proper checks upon actually opening these as well of course
+			if (INFO.required && !std::filesystem::is_regular_file(INFO.path)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	Output::Output(bool binary) {
+		// without this remove first it may crash trying to open a hidden file
+		// (I mean, this isn't atomic so that can happen anyway but at least it's not our fault then)
+		// this is just a temp file so deleting it should be fine
+		std::filesystem::remove(FILE_NAME);
+
+		fileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+		fileStream.open(FILE_NAME, std::ios::trunc | (std::ios::binary * binary), _SH_DENYRW);
+
+		#ifdef WINDOWS
+		setFileAttributeHidden(true, FILE_NAME);
+		#endif
+	}
+
+	Output::Output(const char* fileName, std::streampos outputPosition, unsigned int queueDepth) : fileName(fileName) {
+		if (!outputPosition) {
+			// same as above, it's a temp file, so it can be deleted
+			std::filesystem::remove(fileName);
+		} else {
+			// anything after the output position may have only been partially written, so it's cut off
+			std::filesystem::resize_file(fileName, (std::uintmax_t)outputPosition);
+		}
+
+		writerOptional.emplace(fileName, outputPosition, queueDepth);
+
+		#ifdef WINDOWS
+		setFileAttributeHidden(true, fileName);
+		#endif
+	}
+
+	Output::~Output() {
+		// the writer must be closed before the file can be unhidden
+		writerOptional = std::nullopt;
+
+		#ifdef WINDOWS
+		setFileAttributeHidden(false, fileName);
+		#endif
+	}
+
+	#ifdef IO_URING
+	void Ring::destroy() {
+		if (entriesPointer != MAP_FAILED) {
+			munmap(entriesPointer, entriesSize);
+		}
+
+		entriesPointer = (io_uring_sqe*)MAP_FAILED;
+
+		// with a single mapping, both rings are in the same one
+		if (completionPointer != MAP_FAILED && completionPointer != submissionPointer) {
+			munmap(completionPointer, completionSize);
+		}
+
+		completionPointer = MAP_FAILED;
+
+		if (submissionPointer != MAP_FAILED) {
+			munmap(submissionPointer, submissionSize);
+		}
+
+		submissionPointer = MAP_FAILED;
+
+		if (fileDescriptor != -1) {
+			close(fileDescriptor);
+		}
+
+		fileDescriptor = -1;
+	}
+
+	void Ring::enter(unsigned submit, unsigned complete, unsigned flags) {
+		while (syscall(__NR_io_uring_enter, fileDescriptor, submit, complete, flags, NULL, 0) == -1) {
+			if (errno != EINTR) {
+				throw std::system_error(errno, std::generic_category());
+			}
+		}
+	}
+
+	Ring::Ring(unsigned int entries) {
+		MAKE_SCOPE_EXIT(destroyScopeExit) {
+			destroy();
+		};
+
+		io_uring_params params = {};
+		fileDescriptor = (int)syscall(__NR_io_uring_setup, entries, &params);
+
+		if (fileDescriptor == -1) {
+			throw std::system_error(errno, std::generic_category());
+		}
+
+		submissionSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+		completionSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		bool singleMapping = params.features & IORING_FEAT_SINGLE_MMAP;
+
+		if (singleMapping) {
+			submissionSize = __max(submissionSize, completionSize);
+			completionSize = submissionSize;
+		}
+
+		submissionPointer = mmap(NULL, submissionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fileDescriptor, IORING_OFF_SQ_RING);
+
+		if (submissionPointer == MAP_FAILED) {
+			throw std::system_error(errno, std::generic_category());
+		}
+
+		completionPointer = singleMapping
+			? submissionPointer
+			: mmap(NULL, completionSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fileDescriptor, IORING_OFF_CQ_RING);
+
+		if (completionPointer == MAP_FAILED) {
+			throw std::system_error(errno, std::generic_category());
+		}
+
+		entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+		entriesPointer = (io_uring_sqe*)mmap(NULL, entriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fileDescriptor, IORING_OFF_SQES);
+
+		if (entriesPointer == MAP_FAILED) {
+			throw std::system_error(errno, std::generic_category());
+		}
+
+		unsigned char* submissionBytePointer = (unsigned char*)submissionPointer;
+		submissionHeadPointer = (unsigned*)(submissionBytePointer + params.sq_off.head);
+		submissionTailPointer = (unsigned*)(submissionBytePointer + params.sq_off.tail);
+		submissionArrayPointer = (unsigned*)(submissionBytePointer + params.sq_off.array);
+		submissionRingMask = *(unsigned*)(submissionBytePointer + params.sq_off.ring_mask);
+
+		unsigned char* completionBytePointer = (unsigned char*)completionPointer;
+		completionHeadPointer = (unsigned*)(completionBytePointer + params.cq_off.head);
+		completionTailPointer = (unsigned*)(completionBytePointer + params.cq_off.tail);
+		completionsPointer = (io_uring_cqe*)(completionBytePointer + params.cq_off.cqes);
+		completionRingMask = *(unsigned*)(completionBytePointer + params.cq_off.ring_mask);
+
+		destroyScopeExit.dismiss();
+	}
+
+	Ring::~Ring() {
+		destroy();
+	}
+
+	// registered buffers are mapped by the kernel once, instead of every time they're written
+	void Ring::registerBuffers(const iovec* iovecs, unsigned int count) {
+		if (syscall(__NR_io_uring_register, fileDescriptor, IORING_REGISTER_BUFFERS, iovecs, count) == -1) {
+			throw std::system_error(errno, std::generic_category());
+		}
+	}
+
+	// the write is submitted right away, the buffer index is returned by wait once it's complete
+	// (there must be no more writes being written at once than there are entries)
+	void Ring::write(int outputFileDescriptor, unsigned int bufferIndex, const void* pointer, size_t size, std::streampos position) {
+		// only this thread ever adds to the submission ring, only the kernel ever takes from it
+		unsigned tail = *submissionTailPointer;
+		unsigned index = tail & submissionRingMask;
+
+		io_uring_sqe &entry = entriesPointer[index];
+		entry = {};
+		entry.opcode = IORING_OP_WRITE_FIXED;
+		entry.fd = outputFileDescriptor;
+		entry.off = (uint64_t)(std::streamoff)position;
+		entry.addr = (uint64_t)pointer;
+		entry.len = (uint32_t)size;
+		entry.buf_index = (uint16_t)bufferIndex;
+		entry.user_data = bufferIndex;
+
+		submissionArrayPointer[index] = index;
+		std::atomic_ref<unsigned>(*submissionTailPointer).store(tail + 1, std::memory_order_release);
+
+		enter(1, 0, 0);
+	}
+
+	// waits for any write to be complete, the result is the size written, or a negative error
+	unsigned int Ring::wait(int32_t &result) {
+		unsigned head = 0;
+
+		for (;;) {
+			// only this thread ever takes from the completion ring, only the kernel ever adds to it
+			head = *completionHeadPointer;
+
+			if (head != std::atomic_ref<unsigned>(*completionTailPointer).load(std::memory_order_acquire)) {
+				break;
+			}
+
+			enter(0, 1, IORING_ENTER_GETEVENTS);
+		}
+
+		const io_uring_cqe &COMPLETION = completionsPointer[head & completionRingMask];
+		result = COMPLETION.res;
+		unsigned int bufferIndex = (unsigned int)COMPLETION.user_data;
+
+		std::atomic_ref<unsigned>(*completionHeadPointer).store(head + 1, std::memory_order_release);
+		return bufferIndex;
+	}
+	#endif
+
+	void Writer::destroy() {
+		#ifdef IO_URING
+		// the buffers must not be freed, or the file closed, while they're still being written
+		// (the results don't matter anymore at this point)
+		if (ringOptional.has_value()) {
+			int32_t result = 0;
+
+			try {
+				while (writingSlots) {
+					ringOptional.value().wait(result);
+					writingSlots--;
+				}
+			} catch (...) {
+				// fail silently
+			}
+
+			ringOptional = std::nullopt;
+		}
+		#endif
+
+		#ifdef MACINTOSH
+		if (fileDescriptor != -1) {
+			close(fileDescriptor);
+		}
+
+		fileDescriptor = -1;
+		#endif
+		#ifdef WINDOWS
+		closeHandle(file);
+		#endif
+
+		#ifdef LINUX
+		if (inputFileDescriptor != -1) {
+			close(inputFileDescriptor);
+		}
+
+		inputFileDescriptor = -1;
+		#endif
+	}
+
+	void Writer::writeFile(std::streampos position, const unsigned char* pointer, size_t size) {
+		#ifdef MACINTOSH
+		ssize_t writtenSize = 0;
+
+		while (size) {
+			writtenSize = pwrite(fileDescriptor, pointer, size, (off_t)position);
+
+			if (writtenSize == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				throw std::system_error(errno, std::generic_category());
+			}
+
+			pointer += writtenSize;
+			size -= writtenSize;
+			position += writtenSize;
+		}
+		#endif
+		#ifdef WINDOWS
+		// writing with an offset writes there, without moving the file pointer
+		OVERLAPPED overlapped = {};
+		DWORD writtenSize = 0;
+
+		while (size) {
+			overlapped.Offset = (DWORD)(ULONGLONG)position;
+			overlapped.OffsetHigh = (DWORD)((ULONGLONG)position >> 32);
+
+			osErr(WriteFile(file, pointer, (DWORD)__min(size, (size_t)MAXDWORD), &writtenSize, &overlapped));
+
+			pointer += writtenSize;
+			size -= writtenSize;
+			position += writtenSize;
+		}
+		#endif
+	}
+
+	#ifdef MACINTOSH
+	// gathers the data straight from where it is, with as few system calls as possible
+	void Writer::writeFile(std::streampos position, const Data::VECTOR &dataVector) {
+		std::vector<iovec> iovecVector(dataVector.size());
+
+		for (Data::VECTOR::size_type i = 0; i < dataVector.size(); i++) {
+			iovecVector[i].iov_base = dataVector[i].pointer.get();
+			iovecVector[i].iov_len = dataVector[i].size;
+		}
+
+		iovec* iovecPointer = iovecVector.data();
+		size_t iovecs = iovecVector.size();
+		ssize_t writtenSize = 0;
+
+		while (iovecs) {
+			writtenSize = pwritev(fileDescriptor, iovecPointer, (int)__min(iovecs, (size_t)IOV_MAX), (off_t)position);
+
+			if (writtenSize == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				throw std::system_error(errno, std::generic_category());
+			}
+
+			position += writtenSize;
+
+			// skip past whatever was written, which may have ended partway through one of them
+			while (iovecs && (size_t)writtenSize >= iovecPointer->iov_len) {
+				writtenSize -= iovecPointer->iov_len;
+				iovecPointer++;
+				iovecs--;
+			}
+
+			if (writtenSize) {
+				iovecPointer->iov_base = (unsigned char*)iovecPointer->iov_base + writtenSize;
+				iovecPointer->iov_len -= writtenSize;
+			}
+		}
+	}
+	#endif
+
+	// the queue depth is how many buffers may be being written while another is filled
+	// (only with IO_URING, otherwise each buffer is written before the next is filled)
+	Writer::Writer(const char* fileName, std::streampos position, unsigned int queueDepth)
+		: bufferPosition(position) {
+		const size_t BUFFER_SIZE = Writer::BUFFER_SIZE;
+
+		MAKE_SCOPE_EXIT(destroyScopeExit) {
+			destroy();
+		};
+
+		#ifdef MACINTOSH
+		fileDescriptor = open(fileName, O_WRONLY | O_CREAT, 0666);
+
+		if (fileDescriptor == -1) {
+			throw std::system_error(errno, std::generic_category());
+		}
+		#endif
+		#ifdef WINDOWS
+		// not shared, same as the file stream would be
+		file = CreateFileA(fileName, GENERIC_WRITE, 0, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		osErr(file);
+		#endif
+
+		#ifdef IO_URING
+		if (queueDepth) {
+			try {
+				ringOptional.emplace(queueDepth);
+				buffers = queueDepth + 1;
+			} catch (std::system_error) {
+				// fail silently, it'll just be written synchronously
+			}
+		}
+		#endif
+
+		buffersPointer = std::unique_ptr<unsigned char[]>(new unsigned char[buffers * BUFFER_SIZE]);
+		bufferPointer = buffersPointer.get();
+
+		#ifdef IO_URING
+		if (ringOptional.has_value()) {
+			std::vector<iovec> iovecVector(buffers);
+
+			for (unsigned int i = 0; i < buffers; i++) {
+				iovecVector[i].iov_base = buffersPointer.get() + i * BUFFER_SIZE;
+				iovecVector[i].iov_len = BUFFER_SIZE;
+			}
+
+			try {
+				ringOptional.value().registerBuffers(iovecVector.data(), buffers);
+				slotVector.resize(buffers);
+			} catch (std::system_error) {
+				// this may fail if too much memory would be locked, in which case it's written synchronously too
+				ringOptional = std::nullopt;
+				buffers = 1;
+
+				buffersPointer = std::unique_ptr<unsigned char[]>(new unsigned char[BUFFER_SIZE]);
+				bufferPointer = buffersPointer.get();
+			}
+		}
+		#endif
+
+		destroyScopeExit.dismiss();
+	}
+
+	Writer::~Writer() {
+		destroy();
+	}
+
+	void Writer::write(const void* pointer, size_t size) {
+		const size_t BUFFER_SIZE = Writer::BUFFER_SIZE;
+
+		const unsigned char* bytePointer = (const unsigned char*)pointer;
+
+		// anything at least as big as the buffer wouldn't be combined with anything anyway
+		if (size >= BUFFER_SIZE) {
+			submit();
+			writeFile(bufferPosition, bytePointer, size);
+			bufferPosition += size;
+			return;
+		}
+
+		size_t copySize = 0;
+
+		while (size) {
+			copySize = __min(size, BUFFER_SIZE - bufferSize);
+			memcpy(bufferPointer + bufferSize, bytePointer, copySize);
+			bufferSize += copySize;
+
+			if (bufferSize == BUFFER_SIZE) {
+				submit();
+			}
+
+			bytePointer += copySize;
+			size -= copySize;
+		}
+	}
+
+	void Writer::write(std::streampos position, const void* pointer, size_t size) {
+		if (position + (std::streamoff)size > tell()) {
+			throw std::logic_error("position must not be past what has been written");
+		}
+
+		const unsigned char* bytePointer = (const unsigned char*)pointer;
+
+		// whatever is before the buffer has already been written, so it's written over in the file
+		if (position < bufferPosition) {
+			#ifdef IO_URING
+			// (once it's done being written, otherwise this might be written over in turn)
+			wait();
+			#endif
+
+			size_t fileSize = (size_t)__min((std::streamoff)size, (std::streamoff)(bufferPosition - position));
+			writeFile(position, bytePointer, fileSize);
+
+			position += fileSize;
+			bytePointer += fileSize;
+			size -= fileSize;
+		}
+
+		// and whatever is in the buffer is written over in the buffer
+		if (size) {
+			memcpy(bufferPointer + (size_t)(position - bufferPosition), bytePointer, size);
+		}
+	}
+
+	// writes the data one after the other, if there's at least a buffer's worth
+	// it's gathered straight from the slabs, instead of being copied into the buffer first
+	// (except on Windows, where gathered writes must be unbuffered, so it's always copied)
+	void Writer::write(const Data::VECTOR &dataVector) {
+		#ifdef MACINTOSH
+		const size_t BUFFER_SIZE = Writer::BUFFER_SIZE;
+
+		size_t size = 0;
+
+		for (
+			Data::VECTOR::const_iterator dataVectorIterator = dataVector.begin();
+			dataVectorIterator != dataVector.end();
+			dataVectorIterator++
+		) {
+			size += dataVectorIterator->size;
+		}
+
+		if (size >= BUFFER_SIZE) {
+			submit();
+			writeFile(bufferPosition, dataVector);
+			bufferPosition += size;
+			return;
+		}
+		#endif
+
+		for (
+			Data::VECTOR::const_iterator dataVectorIterator = dataVector.begin();
+			dataVectorIterator != dataVector.end();
+			dataVectorIterator++
+		) {
+			write(dataVectorIterator->pointer.get(), dataVectorIterator->size);
+		}
+	}
+
+	// leaves space to be written over later (it's zeroed, in case it's still in the buffer by then)
+	void Writer::fill(std::streamsize count) {
+		const size_t BUFFER_SIZE = Writer::BUFFER_SIZE;
+
+		if (count >= (std::streamsize)BUFFER_SIZE) {
+			skip(count);
+			return;
+		}
+
+		size_t fillSize = 0;
+
+		while (count) {
+			fillSize = __min((size_t)count, BUFFER_SIZE - bufferSize);
+			memset(bufferPointer + bufferSize, 0, fillSize);
+			bufferSize += fillSize;
+
+			if (bufferSize == BUFFER_SIZE) {
+				submit();
+			}
+
+			count -= fillSize;
+		}
+	}
+
+	// leaves space that is never in the buffer, so it can be written with place
+	// (the file is extended with zeros once anything is written after this)
+	void Writer::skip(std::streamsize count) {
+		submit();
+		bufferPosition += count;
+	}
+
+	// unlike the other methods, this may be called from any thread, to write into space left with skip
+	void Writer::place(std::streampos position, const void* pointer, size_t size) {
+		writeFile(position, (const unsigned char*)pointer, size);
+	}
+
+	// hands the buffer off to be written and moves on to the next one
+	// after this, what was in the buffer may not be in the file yet (unless it's written synchronously)
+	void Writer::submit() {
+		if (!bufferSize) {
+			return;
+		}
+
+		#ifdef IO_URING
+		if (ringOptional.has_value()) {
+			const size_t BUFFER_SIZE = Writer::BUFFER_SIZE;
+
+			Slot &slot = slotVector[bufferIndex];
+			slot.position = bufferPosition;
+			slot.size = bufferSize;
+			slot.writing = true;
+
+			ringOptional.value().write(fileDescriptor, bufferIndex, bufferPointer, bufferSize, bufferPosition);
+			writingSlots++;
+
+			bufferPosition += bufferSize;
+			bufferSize = 0;
+
+			bufferIndex = (bufferIndex + 1) % buffers;
+			bufferPointer = buffersPointer.get() + bufferIndex * BUFFER_SIZE;
+
+			// the next buffer may still be being written from the last time around
+			while (slotVector[bufferIndex].writing) {
+				complete();
+			}
+			return;
+		}
+		#endif
+
+		writeFile(bufferPosition, bufferPointer, bufferSize);
+		bufferPosition += bufferSize;
+		bufferSize = 0;
+	}
+
+	#ifdef IO_URING
+	// waits for any buffer to be done being written
+	void Writer::complete() {
+		const size_t BUFFER_SIZE = Writer::BUFFER_SIZE;
+
+		int32_t result = 0;
+		unsigned int index = ringOptional.value().wait(result);
+
+		Slot &slot = slotVector[index];
+		slot.writing = false;
+		writingSlots--;
+
+		if (result < 0) {
+			throw std::system_error(-result, std::generic_category());
+		}
+
+		// if only some of it was written, the rest is written synchronously
+		size_t writtenSize = (size_t)result;
+
+		if (writtenSize < slot.size) {
+			writeFile(slot.position + (std::streamoff)writtenSize, buffersPointer.get() + index * BUFFER_SIZE + writtenSize, slot.size - writtenSize);
+		}
+	}
+
+	// waits for all the buffers to be done being written
+	void Writer::wait() {
+		while (writingSlots) {
+			complete();
+		}
+	}
+	#endif
+
+	// after this, everything written so far is in the file
+	void Writer::flush() {
+		submit();
+
+		#ifdef IO_URING
+		wait();
+		#endif
+	}
+
+	std::streampos Writer::tell() const {
+		return bufferPosition + (std::streamoff)bufferSize;
+	}
+
+	#ifdef LINUX
+	void Writer::openPassthrough(const std::filesystem::path &inputPath) {
+		inputFileDescriptor = open(inputPath.c_str(), O_RDONLY);
+
+		if (inputFileDescriptor == -1) {
+			throw std::system_error(errno, std::generic_category());
+		}
+	}
+
+	void Writer::passthrough(std::streampos inputPosition, std::streamsize count) {
+		copy(inputFileDescriptor, (off_t)inputPosition, (size_t)count);
+	}
+
+	// copies the whole of another file to the end of this one, returning its size
+	std::streamsize Writer::stitch(const char* fileName) {
+		int sourceFileDescriptor = open(fileName, O_RDONLY);
+
+		if (sourceFileDescriptor == -1) {
+			throw std::system_error(errno, std::generic_category());
+		}
+
+		SCOPE_EXIT {
+			close(sourceFileDescriptor);
+		};
+
+		off_t count = lseek(sourceFileDescriptor, 0, SEEK_END);
+
+		if (count == -1) {
+			throw std::system_error(errno, std::generic_category());
+		}
+
+		copy(sourceFileDescriptor, 0, (size_t)count);
+		return count;
+	}
+
+	void Writer::copy(int sourceFileDescriptor, off_t inputOffset, size_t count) {
+		// anything still in the buffer goes before what comes after it
+		submit();
+
+		off_t outputOffset = (off_t)bufferPosition;
+		size_t remainingCount = count;
+
+		// copy_file_range may not work between some filesystems or on older kernels, then sendfile is tried
+		// and if that doesn't work either, it's read and written the usual way
+		if (!copyFileRange(sourceFileDescriptor, inputOffset, outputOffset, remainingCount)) {
+			if (!sendFile(sourceFileDescriptor, inputOffset, outputOffset, remainingCount)) {
+				copyRead(sourceFileDescriptor, inputOffset, outputOffset, remainingCount);
+			}
+		}
+
+		bufferPosition += count;
+	}
+
+	bool Writer::copyFileRange(int sourceFileDescriptor, off_t &inputOffset, off_t &outputOffset, size_t &count) {
+		ssize_t copiedCount = 0;
+
+		while (count) {
+			copiedCount = copy_file_range(sourceFileDescriptor, &inputOffset, fileDescriptor, &outputOffset, count, 0);
+
+			if (copiedCount == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				if (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP) {
+					return false;
+				}
+
+				throw std::system_error(errno, std::generic_category());
+			}
+
+			// the input file ended early
+			if (!copiedCount) {
+				throw std::logic_error("count must not be greater than file size");
+			}
+
+			count -= copiedCount;
+		}
+		return true;
+	}
+
+	bool Writer::sendFile(int sourceFileDescriptor, off_t &inputOffset, off_t &outputOffset, size_t &count) {
+		// sendfile writes wherever the output file is, so it's moved to the output offset first
+		if (lseek(fileDescriptor, outputOffset, SEEK_SET) == -1) {
+			throw std::system_error(errno, std::generic_category());
+		}
+
+		ssize_t copiedCount = 0;
+
+		while (count) {
+			copiedCount = sendfile(fileDescriptor, sourceFileDescriptor, &inputOffset, count);
+
+			if (copiedCount == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				if (errno == ENOSYS || errno == EINVAL) {
+					return false;
+				}
+
+				throw std::system_error(errno, std::generic_category());
+			}
+
+			if (!copiedCount) {
+				throw std::logic_error("count must not be greater than file size");
+			}
+
+			count -= copiedCount;
+			outputOffset += copiedCount;
+		}
+		return true;
+	}
+
+	void Writer::copyRead(int sourceFileDescriptor, off_t &inputOffset, off_t &outputOffset, size_t &count) {
+		const size_t SLAB_SIZE = Data::SLAB_SIZE;
+
+		Data::POINTER pointer = Data::allocateSlab();
+		ssize_t readCount = 0;
+		ssize_t writtenCount = 0;
+
+		while (count) {
+			readCount = pread(sourceFileDescriptor, pointer.get(), __min(count, SLAB_SIZE), inputOffset);
+
+			if (readCount == -1) {
+				if (errno == EINTR) {
+					continue;
+				}
+
+				throw std::system_error(errno, std::generic_category());
+			}
+
+			if (!readCount) {
+				throw std::logic_error("count must not be greater than file size");
+			}
+
+			for (ssize_t i = 0; i < readCount; i += writtenCount) {
+				writtenCount = pwrite(fileDescriptor, pointer.get() + i, readCount - i, outputOffset + i);
+
+				if (writtenCount == -1) {
+					if (errno == EINTR) {
+						writtenCount = 0;
+						continue;
+					}
+
+					throw std::system_error(errno, std::generic_category());
+				}
+			}
+
+			count -= readCount;
+			inputOffset += readCount;
+			outputOffset += readCount;
+		}
+	}
+	#endif
+
+	const char* Reorder::SPILL_FILE_NAME = "~M4RS.tmp"; // must be an 8.3 filename
+
+	// the data is already counted against the memory budget, so spilling it takes it back off
+	void Reorder::spill(Chunk &chunk) {
+		if (!spillFileStream.is_open()) {
+			spillFileStream.exceptions(std::fstream::failbit | std::fstream::badbit);
+			spillFileStream.open(spillFileName, std::ios::binary | std::ios::in | std::ios::out | std::ios::trunc);
+
+			#ifdef WINDOWS
+			setFileAttributeHidden(true, spillFileName);
+			#endif
+		}
+
+		spillFileStream.seekp(spillPosition);
+		writeStream(spillFileStream, chunk.data.pointer.get(), chunk.data.size);
+
+		chunk.spillPosition = spillPosition;
+		spillPosition += chunk.data.size;
+		spilledChunks++;
+
+		chunk.data.pointer = 0;
+		memoryGate.leave(chunk.data.size);
+	}
+
+	Reorder::Reorder(Gate &memoryGate, const char* spillFileName)
+		: memoryGate(memoryGate),
+		spillFileName(spillFileName) {
+	}
+
+	Reorder::~Reorder() {
+		// whatever is left was never written, so it still counts against the memory budget
+		for (
+			TAKEN_MAP::iterator takenMapIterator = takenMap.begin();
+			takenMapIterator != takenMap.end();
+			takenMapIterator++
+		) {
+			CHUNK_DEQUE &chunkDeque = takenMapIterator->second.chunkDeque;
+
+			for (
+				CHUNK_DEQUE::iterator chunkDequeIterator = chunkDeque.begin();
+				chunkDequeIterator != chunkDeque.end();
+				chunkDequeIterator++
+			) {
+				if (chunkDequeIterator->data.pointer) {
+					memoryGate.leave(chunkDequeIterator->data.size);
+				}
+			}
+		}
+
+		if (spillFileStream.is_open()) {
+			spillFileStream.close();
+
+			std::error_code errorCode = {};
+			std::filesystem::remove(spillFileName, errorCode);
+		}
+	}
+
+	// takes whatever data the FileTask has so far, returns true if there was any
+	bool Reorder::take(FileTask &fileTask) {
+		Data data = {};
+
+		if (!fileTask.tryPop(data)) {
+			return false;
+		}
+
+		Taken &taken = takenMap[&fileTask];
+
+		do {
+			// a null pointer signals that the file is complete
+			if (!data.pointer) {
+				taken.completed = true;
+				break;
+			}
+
+			Chunk chunk = { std::move(data) };
+
+			if (memoryGate.full()) {
+				spill(chunk);
+			}
+
+			taken.chunkDeque.push_back(std::move(chunk));
+		} while (fileTask.tryPop(data));
+		return true;
 	}
 
-	// the point of this method is to make it so that
-	// one thread will wait until another is doing work
-	// then, continue waiting while it does that work
-	// and then, finally, immediately wake up only once it is done that work
-	// that way we do not have to sleep in a loop
-	// however, in order to prevent busy waiting
-	// the waiting thread must "yield" to other threads
-	// meaning, it won't wake up more than once in a row
-	// if no work is currently happening
-	void Event::wait(bool &yield, bool reset) {
-		std::unique_lock<std::mutex> lock(mutex);
+	// if the memory budget has run out, spills everything taken so far, returns true if there was anything to spill
+	// (otherwise, whoever is waiting to read more might be waiting on the data we're keeping)
+	bool Reorder::spill() {
+		if (!memoryGate.full()) {
+			return false;
+		}
 
-		conditionVariable.wait(lock, [&] {
-			// prevent spurious wakeup
-			// if we are yielding, we don't allow waking up until some other thread than us is the one that has set the event
-			// otherwise, all that matters is that the event was in fact set (i.e., the owning lock isn't currently in use by anyone)
-			if (threadIDOptional.has_value() && (!yield || threadIDOptional != std::this_thread::get_id())) {
-				// reset the event if desired (this is run while the lock is held, so is safe)
-				if (reset) {
-					// if the event is reset
-					// then that should cause this to wait (return false)
-					threadIDOptional = std::nullopt;
+		bool spilled = false;
+
+		for (
+			TAKEN_MAP::iterator takenMapIterator = takenMap.begin();
+			takenMapIterator != takenMap.end();
+			takenMapIterator++
+		) {
+			CHUNK_DEQUE &chunkDeque = takenMapIterator->second.chunkDeque;
+
+			for (
+				CHUNK_DEQUE::iterator chunkDequeIterator = chunkDeque.begin();
+				chunkDequeIterator != chunkDeque.end();
+				chunkDequeIterator++
+			) {
+				if (chunkDequeIterator->data.pointer) {
+					spill(*chunkDequeIterator);
+					spilled = true;
 				}
-				return true;
 			}
-			return false;
-		});
+		}
+		return spilled;
 	}
 
-	void Event::wait(bool reset) {
-		bool yield = false;
-		wait(yield, reset);
-	}
+	// writes the data that was taken, either in order or where the FileTask was placed
+	void Reorder::write(Taken &taken, Writer &writer) {
+		CHUNK_DEQUE &chunkDeque = taken.chunkDeque;
 
-	// wake up the next thread
-	void Event::set() {
-		setPredicate(true);
-		conditionVariable.notify_one();
-	}
+		Data::POINTER spillPointer = 0;
+		const unsigned char* pointer = 0;
 
-	void Event::reset() {
-		setPredicate(false);
-	}
+		while (!chunkDeque.empty()) {
+			Chunk &chunk = chunkDeque.front();
+			Data &data = chunk.data;
 
-	Data::Data() {
-	}
+			if (data.pointer) {
+				pointer = data.pointer.get();
+			} else {
+				if (!spillPointer) {
+					spillPointer = Data::allocateSlab();
+				}
 
-	Data::Data(size_t size, POINTER pointer)
-		: size(size),
-		pointer(pointer) {
-	}
+				spillFileStream.seekg(chunk.spillPosition);
+				readStream(spillFileStream, spillPointer.get(), data.size);
+				pointer = spillPointer.get();
 
-	BigFileTask::BigFileTask(
-		std::istream &inputStream,
-		std::streampos ownerBigFileInputPosition,
-		Ubi::BigFile::File &file,
-		Ubi::BigFile::File::POINTER_SET_MAP &fileVectorIteratorSetMap
-	)
-		: ownerBigFileInputPosition(ownerBigFileInputPosition),
-		file(file),
-		bigFilePointer(std::make_shared<Ubi::BigFile>(inputStream, fileSystemSize, files, fileVectorIteratorSetMap, file)) {
-	}
+				// once nothing is left in the spill file, it's started over from the beginning
+				if (!--spilledChunks) {
+					spillPosition = 0;
+				}
+			}
 
-	std::streampos BigFileTask::getOwnerBigFileInputPosition() const {
-		return ownerBigFileInputPosition;
-	}
+			if (taken.placedPosition == -1) {
+				writer.write(pointer, data.size);
+			} else {
+				writer.place(taken.placedPosition, pointer, data.size);
+				taken.placedPosition += data.size;
+			}
 
-	Ubi::BigFile::File &BigFileTask::getFile() const {
-		return file;
-	}
+			if (data.pointer) {
+				data.pointer = 0;
+				memoryGate.leave(data.size);
+			}
 
-	Ubi::BigFile::File::SIZE BigFileTask::getFileSystemSize() const {
-		return fileSystemSize;
+			chunkDeque.pop_front();
+		}
 	}
 
-	Ubi::BigFile::File::POINTER_VECTOR::size_type BigFileTask::getFiles() const {
-		return files;
-	}
+	// writes whatever data was taken from the FileTask, returns true if that was all of it
+	bool Reorder::write(FileTask &fileTask, Writer &writer) {
+		TAKEN_MAP::iterator takenMapIterator = takenMap.find(&fileTask);
 
-	Ubi::BigFile::POINTER BigFileTask::getBigFilePointer() const {
-		return bigFilePointer;
-	}
+		if (takenMapIterator == takenMap.end()) {
+			return false;
+		}
 
-	FileTask::FileTask(std::streampos ownerBigFileInputPosition, Ubi::BigFile::File* filePointer)
-		: ownerBigFileInputPosition(ownerBigFileInputPosition),
-		fileVariant(filePointer),
-		event(true) {
-	}
+		Taken &taken = takenMapIterator->second;
+		write(taken, writer);
 
-	FileTask::FileTask(std::streampos ownerBigFileInputPosition, Ubi::BigFile::File::POINTER_VECTOR_POINTER &filePointerVectorPointer)
-		: ownerBigFileInputPosition(ownerBigFileInputPosition),
-		fileVariant(filePointerVectorPointer),
-		event(true) {
+		bool completed = taken.completed;
+		takenMap.erase(takenMapIterator);
+		return completed;
 	}
 
-	// called in order to lock the data queue so we can add new data
-	// the Lock class ensures the output thread will automatically wake up to write it after we add the new data
-	Data::QUEUE_LOCK FileTask::lock(bool &yield) {
-		return Data::QUEUE_LOCK(event, queue, yield);
-	}
+	// leaves space for the FileTask's planned size, and writes whatever data was taken from it there
+	// the rest is written there by whoever is converting it, or by takePlaced, returns true if that was all of it
+	bool Reorder::place(const FileTask::POINTER &fileTaskPointer, Writer &writer) {
+		FileTask &fileTask = *fileTaskPointer;
 
-	Data::QUEUE_LOCK FileTask::lock() {
-		bool yield = false;
-		return lock(yield);
-	}
+		std::streampos position = writer.tell();
+		writer.skip(fileTask.getPlannedSize());
 
-	void FileTask::copy(std::istream &inputStream, std::streamsize count) {
-		if (!count) {
-			return;
-		}
+		Taken &taken = takenMap[&fileTask];
+		taken.placedPosition = position;
+		write(taken, writer);
 
-		const size_t BUFFER_SIZE = 0x10000;
+		// whatever is added after this is written straight to the file
+		// (whoever is converting it knows how much it added before, so it's given where the file begins)
+		fileTask.place(writer, position);
 
-		std::streamsize countRead = BUFFER_SIZE;
-		std::streamsize gcountRead = 0;
+		if (taken.completed) {
+			takenMap.erase(&fileTask);
+			return true;
+		}
 
-		do {
-			countRead = (std::streamsize)__min((size_t)count, (size_t)countRead);
+		placedQueue.push_back(fileTaskPointer);
+		return false;
+	}
 
-			{
-				Data::POINTER pointer(new unsigned char[(size_t)countRead]);
+	// takes whatever data the placed FileTasks have so far and writes it where it goes, returns true if there was any
+	// (this is only the data that was added before they were placed, and the null pointer signalling they're complete)
+	bool Reorder::takePlaced(Writer &writer) {
+		bool result = false;
+		bool completed = false;
 
-				readStreamPartial(inputStream, pointer.get(), countRead, gcountRead);
+		Data data = {};
+		FileTask::POINTER_QUEUE::iterator placedQueueIterator = placedQueue.begin();
 
-				if (!gcountRead) {
-					break;
-				}
+		while (placedQueueIterator != placedQueue.end()) {
+			FileTask &fileTask = **placedQueueIterator;
+			TAKEN_MAP::iterator takenMapIterator = takenMap.find(&fileTask);
+			std::streampos &placedPosition = takenMapIterator->second.placedPosition;
 
-				lock().get().emplace((size_t)gcountRead, pointer);
-			}
+			completed = false;
 
-			if (count != -1) {
-				count -= gcountRead;
+			while (fileTask.tryPop(data)) {
+				result = true;
 
-				if (!count) {
+				// a null pointer signals that the file is complete
+				if (!data.pointer) {
+					completed = true;
 					break;
 				}
+
+				writer.place(placedPosition, data.pointer.get(), data.size);
+				placedPosition += data.size;
+
+				data.pointer = 0;
+				memoryGate.leave(data.size);
 			}
-		} while (countRead == gcountRead);
 
-		if (count != -1) {
-			if (count) {
-				throw std::logic_error("count must not be greater than file size");
+			if (completed) {
+				takenMap.erase(takenMapIterator);
+				placedQueueIterator = placedQueue.erase(placedQueueIterator);
+			} else {
+				placedQueueIterator++;
 			}
 		}
+		return result;
 	}
 
-	// called to signal to the output thread that we are done adding new data
-	void FileTask::complete() {
-		lock().get().emplace();
+	// true if any placed FileTasks have yet to be completed
+	bool Reorder::getPlaced() const {
+		return !placedQueue.empty();
 	}
 
-	std::streampos FileTask::getOwnerBigFileInputPosition() {
-		return ownerBigFileInputPosition;
-	}
+	void Journal::open(std::istream &inputStream, const std::filesystem::path &path) {
+		Index::Key key(inputStream, path);
 
-	FileTask::FILE_VARIANT FileTask::getFileVariant() {
-		return fileVariant;
-	}
+		std::ostringstream headerStream(std::ios::binary);
+		Ubi::String::writeOptional(headerStream, SIGNATURE);
 
-	Tasks::Tasks()
-		: bigFileEvent(true),
-		fileEvent(true) {
-	}
+		VERSION version = CURRENT_VERSION;
+		writeStream(headerStream, &version, sizeof(version));
 
-	BigFileTask::POINTER_MAP_LOCK Tasks::bigFileLock(bool &yield) {
-		return BigFileTask::POINTER_MAP_LOCK(bigFileEvent, bigFileTaskPointerMap, yield);
-	}
+		key.write(headerStream);
+		header = headerStream.str();
 
-	BigFileTask::POINTER_MAP_LOCK Tasks::bigFileLock() {
-		bool yield = false;
-		return bigFileLock(yield);
-	}
+		try {
+			std::string journal = "";
 
-	FileTask::POINTER_QUEUE_LOCK Tasks::fileLock(bool &yield) {
-		return FileTask::POINTER_QUEUE_LOCK(fileEvent, fileTaskPointerQueue, yield);
-	}
+			{
+				std::ifstream journalFileStream;
+				journalFileStream.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+				journalFileStream.open(FILE_NAME, std::ios::binary);
 
-	FileTask::POINTER_QUEUE_LOCK Tasks::fileLock() {
-		bool yield = false;
-		return fileLock(yield);
-	}
+				journal.resize((std::string::size_type)std::filesystem::file_size(FILE_NAME));
+				readStream(journalFileStream, journal.data(), journal.size());
+			}
 
-	Convert::Convert(
-		const Configuration &configuration,
-		const nvtt::Context &context,
-		Ubi::BigFile::File &file
-	)
-		: CONFIGURATION(configuration),
-		CONTEXT(context),
-		file(file) {
+			size_t size = load(journal);
+
+			// the output must still have everything the journal says was written to it
+			if (checkpointOptional.has_value()) {
+				if (std::filesystem::file_size(OUTPUT_FILE_NAME) < (std::uintmax_t)checkpointOptional.value().outputPosition) {
+					throw Invalid();
+				}
+			}
+
+			// a record that was only partially written is cut off, so the next one goes right after the last whole one
+			std::filesystem::resize_file(FILE_NAME, size);
+
+			fileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+			fileStream.open(FILE_NAME, std::ios::binary | std::ios::app);
+			return;
+		} catch (std::system_error) {
+			// the journal doesn't exist or couldn't be read
+		} catch (std::invalid_argument) {
+			// the journal is for a different input file or is corrupt
+		}
+
+		create();
 	}
 
-	const char* Output::FILE_NAME = "~M4R.tmp"; // must be an 8.3 filename
-	const char* Output::FILE_RETRY = "The game files could not be accessed. Please ensure the game is not open while using this tool. If this error is occuring and the game is not open, you may be out of disk space, or you may need to run this tool as admin.";
+	void Journal::create() {
+		checkpointOptional = std::nullopt;
+		files = 0;
 
-	const Output::INFO_MAP Output::FILE_PATH_INFO_MAP = {
-		{FILE_PATH_DATA, {GAMEDATABINDIR "/data.m4b", true}},
-		{FILE_PATH_USER_PREFERENCE, {EXEDIR "/user.dsc", false}},
-		{FILE_PATH_M4_THOR, {EXEDIR "/m4_thor_rd.dll", true}},
-		{FILE_PATH_M4_AI_GLOBAL, {EXEDIR "/m4_ai_global_rd.dll", true}},
-		{FILE_PATH_GFX_TOOLS, {EXEDIR "/gfx_tools_rd.dll", true}}
-	};
+		if (fileStream.is_open()) {
+			fileStream.close();
+		}
 
-	const std::filesystem::path Output::DATA_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_DATA).path;
-	const std::filesystem::path Output::USER_PREFERENCE_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_USER_PREFERENCE).path;
-	const std::filesystem::path Output::M4_THOR_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_M4_THOR).path;
-	const std::filesystem::path Output::M4_AI_GLOBAL_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_M4_AI_GLOBAL).path;
-	const std::filesystem::path Output::GFX_TOOLS_PATH = FILE_PATH_INFO_MAP.at(FILE_PATH_GFX_TOOLS).path;
+		fileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+		fileStream.open(FILE_NAME, std::ios::binary | std::ios::trunc);
 
-	void Output::findInstallPath(const std::filesystem::path &path) {
-		bool foundInstalled = setPath(path);
+		writeStream(fileStream, header.data(), header.size());
+		fileStream.flush();
+	}
 
-		if (foundInstalled) {
-			consoleLog("An install of Myst IV: Revelation was found at this path:");
-			consoleLog(path.string().c_str(), 2);
+	size_t Journal::load(const std::string &journal) {
+		checkpointOptional = std::nullopt;
+		files = 0;
 
-			foundInstalled = consoleBool("Is this the path to the install you would like to modify?", true);
-		} else {
-			consoleLog("No install of Myst IV: Relevation was found. ", false);
+		if (journal.compare(0, header.size(), header)) {
+			throw Invalid();
 		}
 
-		if (!foundInstalled) {
-			while (!setPath(consoleString("Please enter the path to Myst IV: Relevation."))) {
-				consoleLog("No install of Myst IV: Relevation was found at this path. ", false);
+		Ubi::SpanReader journalReader((const unsigned char*)journal.data(), journal.size(), header.size());
+		size_t size = journalReader.tell();
+
+		Checkpoint checkpoint = {};
+
+		FILES filesBegin = 0;
+		FILES filesEnd = 0;
+		POSITION outputPosition = 0;
+		HASH recordHash = 0;
+
+		// each record carries on from the one before it, and the last whole one is the checkpoint
+		// the first record that isn't whole, or doesn't carry on, is where the journal ends
+		try {
+			for (;;) {
+				if (journalReader.tell() == journalReader.getSize()) {
+					break;
+				}
+
+				journalReader.read(&filesBegin, sizeof(filesBegin));
+				journalReader.read(&filesEnd, sizeof(filesEnd));
+
+				if (filesBegin != files || filesEnd <= filesBegin) {
+					break;
+				}
+
+				journalReader.read(&outputPosition, sizeof(outputPosition));
+				journalReader.read(&checkpoint.filePosition, sizeof(checkpoint.filePosition));
+				journalReader.read(&checkpoint.inputCopyPosition, sizeof(checkpoint.inputCopyPosition));
+				journalReader.read(&checkpoint.inputFilePosition, sizeof(checkpoint.inputFilePosition));
+
+				// this is checked before reading the files so a corrupt count can't make a huge vector
+				const size_t FILE_SIZE = sizeof(Checkpoint::File::size) + sizeof(Checkpoint::File::position);
+
+				if ((size_t)(filesEnd - filesBegin) * FILE_SIZE > journalReader.getSize() - journalReader.tell()) {
+					break;
+				}
+
+				for (FILES i = filesBegin; i < filesEnd; i++) {
+					Checkpoint::File file = {};
+					journalReader.read(&file.size, sizeof(file.size));
+					journalReader.read(&file.position, sizeof(file.position));
+					checkpoint.fileVector.push_back(file);
+				}
+
+				const size_t RECORD_END = journalReader.tell();
+				journalReader.read(&recordHash, sizeof(recordHash));
+
+				if (recordHash != Cache::hash((const unsigned char*)journal.data() + size, RECORD_END - size)) {
+					break;
+				}
+
+				checkpoint.outputPosition = (std::streampos)outputPosition;
+				checkpointOptional = checkpoint;
+
+				files = filesEnd;
+				size = journalReader.tell();
 			}
+		} catch (Ubi::SpanReader::ReadPastEnd) {
+			// the record was only partially written
 		}
+		return size;
 	}
 
-	bool Output::setPath(const std::filesystem::path &path) {
+	const std::string Journal::SIGNATURE = "M4R_JNL_SIG";
+	const char* Journal::FILE_NAME = "~M4R.jnl"; // must be an 8.3 filename
+	const char* Journal::OUTPUT_FILE_NAME = "~M4RJ.tmp"; // must be an 8.3 filename
+
+	Journal::Journal(std::istream &inputStream, const std::filesystem::path &path) {
+		std::streampos position = inputStream.tellg();
+
+		// like the index, the stream is put back where it was
 		try {
-			std::filesystem::current_path(path);
-		} catch (std::filesystem::filesystem_error) {
+			open(inputStream, path);
+		} catch (...) {
+			inputStream.clear();
+			inputStream.seekg(position);
+			throw;
+		}
+
+		inputStream.seekg(position);
+	}
+
+	const std::optional<Journal::Checkpoint> &Journal::getCheckpointOptional() const {
+		return checkpointOptional;
+	}
+
+	bool Journal::restore(
+		Ubi::BigFile &bigFile,
+		Ubi::BigFile::Position::VECTOR::size_type &files,
+		Ubi::BigFile::File::SIZE &inputCopyPosition,
+		Ubi::BigFile::File::SIZE &inputFilePosition
+	) {
+		if (!checkpointOptional.has_value()) {
 			return false;
 		}
 
-		for (INFO_MAP::const_iterator infoMapIterator = FILE_PATH_INFO_MAP.begin(); infoMapIterator != FILE_PATH_INFO_MAP.end(); infoMapIterator++) {
-			const Info &INFO = infoMapIterator->second;
+		const Checkpoint &CHECKPOINT = checkpointOptional.value();
+		const Ubi::BigFile::Position::VECTOR &POSITION_VECTOR = bigFile.positionVector;
+		const Checkpoint::File::VECTOR::size_type CHECKPOINT_FILES = CHECKPOINT.fileVector.size();
+
+		// it must end between two different positions, and where fixLoading would've been when it got there
+		if (!CHECKPOINT_FILES
+			|| CHECKPOINT_FILES >= POSITION_VECTOR.size()
+			|| POSITION_VECTOR[CHECKPOINT_FILES].position == POSITION_VECTOR[CHECKPOINT_FILES - 1].position
+			|| CHECKPOINT.inputCopyPosition != POSITION_VECTOR[CHECKPOINT_FILES].position
+			|| CHECKPOINT.inputFilePosition > CHECKPOINT.inputCopyPosition) {
+			// this shouldn't happen unless the journal is corrupt, so it's started over
+			create();
+			return false;
+		}
 
-			// this check is just to prevent the user from being dumb
-			// we need proper checks upon actually opening these as well of course
-			if (INFO.required && !std::filesystem::is_regular_file(INFO.path)) {
-				return false;
-			}
+		for (Checkpoint::File::VECTOR::size_type i = 0; i < CHECKPOINT_FILES; i++) {
+			Ubi::BigFile::File &file = bigFile.fileVector[POSITION_VECTOR[i].fileIndex];
+			file.size = CHECKPOINT.fileVector[i].size;
+			file.position = CHECKPOINT.fileVector[i].position;
 		}
+
+		files = CHECKPOINT_FILES;
+		inputCopyPosition = CHECKPOINT.inputCopyPosition;
+		inputFilePosition = CHECKPOINT.inputFilePosition;
 		return true;
 	}
 
-	Output::Output(bool binary) {
-		// without this remove first it may crash trying to open a hidden file
-		// (I mean, this isn't atomic so that can happen anyway but at least it's not our fault then)
-		// this is just a temp file so deleting it should be fine
-		std::filesystem::remove(FILE_NAME);
+	void Journal::write(
+		const Ubi::BigFile &bigFile,
+		Ubi::BigFile::File::POINTER_VECTOR::size_type files,
+		std::streampos outputPosition,
+		Ubi::BigFile::File::SIZE filePosition,
+		bool copied
+	) {
+		// the files after one that was cut short are in the wrong place, so it can't carry on from any of them
+		if (stopped) {
+			return;
+		}
 
-		fileStream.exceptions(std::ofstream::failbit | std::ofstream::badbit);
-		fileStream.open(FILE_NAME, std::ios::trunc | (std::ios::binary * binary), _SH_DENYRW);
+		const Ubi::BigFile::Position::VECTOR &POSITION_VECTOR = bigFile.positionVector;
 
-		#ifdef WINDOWS
-		setFileAttributeHidden(true, FILE_NAME);
-		#endif
+		// files at the same position are all done at once, so it can only carry on from between two positions
+		// (and there's no point in carrying on once every file is done)
+		if (files <= this->files
+			|| files >= POSITION_VECTOR.size()
+			|| POSITION_VECTOR[files].position == POSITION_VECTOR[files - 1].position) {
+			return;
+		}
+
+		// if the files were copied, the next file is being converted
+		// so fixLoading has only moved the input file position up to the last copied file
+		const Ubi::BigFile::File::SIZE INPUT_COPY_POSITION = POSITION_VECTOR[files].position;
+		const Ubi::BigFile::File::SIZE INPUT_FILE_POSITION = copied ? POSITION_VECTOR[files - 1].position : INPUT_COPY_POSITION;
+
+		std::ostringstream recordStream(std::ios::binary);
+
+		FILES filesBegin = this->files;
+		FILES filesEnd = (FILES)files;
+		writeStream(recordStream, &filesBegin, sizeof(filesBegin));
+		writeStream(recordStream, &filesEnd, sizeof(filesEnd));
+
+		POSITION position = (POSITION)outputPosition;
+		writeStream(recordStream, &position, sizeof(position));
+		writeStream(recordStream, &filePosition, sizeof(filePosition));
+		writeStream(recordStream, &INPUT_COPY_POSITION, sizeof(INPUT_COPY_POSITION));
+		writeStream(recordStream, &INPUT_FILE_POSITION, sizeof(INPUT_FILE_POSITION));
+
+		for (FILES i = filesBegin; i < filesEnd; i++) {
+			const Ubi::BigFile::File &FILE = bigFile.fileVector[POSITION_VECTOR[i].fileIndex];
+			writeStream(recordStream, &FILE.size, sizeof(FILE.size));
+			writeStream(recordStream, &FILE.position, sizeof(FILE.position));
+		}
+
+		const std::string RECORD = recordStream.str();
+		HASH recordHash = Cache::hash((const unsigned char*)RECORD.data(), RECORD.size());
+
+		writeStream(fileStream, RECORD.data(), RECORD.size());
+		writeStream(fileStream, &recordHash, sizeof(recordHash));
+		fileStream.flush();
+
+		this->files = filesEnd;
 	}
 
-	Output::~Output() {
-		#ifdef WINDOWS
-		setFileAttributeHidden(false, FILE_NAME);
-		#endif
+	void Journal::stop() {
+		stopped = true;
+	}
+
+	void Journal::remove() {
+		std::error_code errorCode = {};
+		std::filesystem::remove(FILE_NAME, errorCode);
+		std::filesystem::remove(OUTPUT_FILE_NAME, errorCode);
 	}
 
 	namespace Backup {
@@ -312,11 +2746,11 @@ namespace Work {
 			consoleLog("A backup has been created.", 2);
 		}
 
-		void create(const char* fileName) {
+		void create(const char* fileName, const char* outputFileName) {
 			bool createdNew = rename(fileName, getPath(fileName).string().c_str());
 
 			// here I use std::filesystem::rename because I do want to overwrite the file if it exists
-			OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::rename(Output::FILE_NAME, fileName), std::filesystem::filesystem_error, Output::FILE_RETRY);
+			OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::rename(outputFileName, fileName), std::filesystem::filesystem_error, Output::FILE_RETRY);
 			
 			if (createdNew) {
 				log();
@@ -348,6 +2782,9 @@ namespace Work {
 
 		void restore(const std::filesystem::path &path) {
 			OPERATION_EXCEPTION_RETRY_ERR(std::filesystem::rename(getPath(path), path), std::filesystem::filesystem_error, Output::FILE_RETRY);
+
+			// the index was for the file that was just replaced
+			Index::remove(path);
 		}
 
 		std::filesystem::path getPath(std::filesystem::path path) {
@@ -420,4 +2857,8 @@ namespace Work {
 
 		copyThread.join();
 	}
+
+	const std::filesystem::path &Edit::getPath() const {
+		return path;
+	}
 }
\ No newline at end of file
@@ -1,22 +1,38 @@
 #pragma once
 #include "shared.h"
 #include "Ubi.h"
+#include "MappedFile.h"
 #include <mutex>
 #include <condition_variable>
 #include <vector>
 #include <queue>
+#include <deque>
 #include <atomic>
+#include <thread>
+#include <exception>
 #include <map>
+#include <set>
 #include <filesystem>
 #include <nvtt/nvtt.h>
 
 #define GAMEDATABINDIR "data"
 #define EXEDIR "bin"
 
-#ifdef WINDOWS
-	#define MULTITHREADED
-#else
-	#define SINGLETHREADED
+// on Windows, MULTITHREADED converts on the system thread pool, everywhere else it uses Work::Pool
+// SINGLETHREADED converts on the same thread that reads the files instead, which is easier to debug
+#define MULTITHREADED
+//#define SINGLETHREADED
+
+// on Linux, IO_URING hands the output to io_uring to be written, so the output thread can fill the next buffer meanwhile
+// (if the kernel doesn't have it, or it's disabled, the output is written synchronously as usual)
+#ifdef LINUX
+#define IO_URING
+#endif
+
+#ifdef IO_URING
+#include <linux/io_uring.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
 #endif
 
 namespace Work {
@@ -69,50 +85,311 @@ namespace Work {
 		}
 	};
 
+	// a pool of threads for platforms without one of their own
+	// work is spread out over a queue for each thread, so submitting to and taking from them doesn't all wait on one lock
+	// but the oldest work of any queue is always taken first, because the output is written in the same order it's submitted
+	class Pool {
+		public:
+		typedef void(*WorkCallback)(void* parameter);
+
+		Pool(unsigned int threads);
+		~Pool();
+		Pool(const Pool &pool) = delete;
+		Pool &operator=(const Pool &pool) = delete;
+		void submit(WorkCallback workCallback, void* parameter);
+
+		private:
+		typedef uint64_t SEQUENCE;
+
+		struct Work {
+			typedef std::deque<Work> DEQUE;
+
+			WorkCallback workCallback = 0;
+			void* parameter = 0;
+			SEQUENCE sequence = 0;
+		};
+
+		struct Queue {
+			std::mutex mutex = {};
+			Work::DEQUE workDeque = {};
+		};
+
+		static void workThread(Pool &pool, unsigned int index);
+
+		void destroy();
+		bool pop(unsigned int index, Work &work);
+
+		unsigned int threads = 0;
+		std::unique_ptr<Queue[]> queues = 0;
+
+		// the order the next work is submitted in, which also picks its queue, so it is spread out evenly
+		std::atomic<SEQUENCE> sequence = 0;
+
+		// works is how many have been submitted, that no thread has claimed yet
+		// so a thread only sleeps when there's nothing to steal either
+		std::mutex mutex = {};
+		std::condition_variable conditionVariable = {};
+		size_t works = 0;
+		bool stop = false;
+
+		std::vector<std::thread> threadVector = {};
+	};
+
+	// wakes up a thread waiting on any one of many others, without a lock
+	// (only costs a system call if that thread is actually asleep)
+	// the count must be gotten before looking for whatever there is to do, then waiting on it waits only if nothing was signalled since
+	class Signal {
+		public:
+		typedef uint32_t COUNT;
+
+		private:
+		std::atomic<COUNT> signalled = 0;
+
+		// more than one thread may wait on the same signal (such as the output thread of each segment)
+		std::atomic<uint32_t> waiting = 0;
+
+		public:
+		Signal();
+		Signal(const Signal &signal) = delete;
+		Signal &operator=(const Signal &signal) = delete;
+		COUNT get();
+		void wait(COUNT count);
+		void notify();
+	};
+
+	// lets only so much of something through at once (a count of tasks, or bytes) and the rest waits until some leaves
+	// (like a semaphore, except the maximum can be set after it's created)
+	// if nothing has entered, anything may, even if it's more than the maximum, so that it can't wait forever
+	class Gate {
+		private:
+		std::mutex mutex = {};
+		std::condition_variable conditionVariable = {};
+		size_t entered = 0;
+		size_t maxEntered = 1;
+
+		// how many threads are waiting to enter, and what to signal when one starts to
+		size_t waiting = 0;
+		Signal* waitingSignalPointer = 0;
+
+		public:
+		Gate();
+		Gate(const Gate &gate) = delete;
+		Gate &operator=(const Gate &gate) = delete;
+		void setMax(size_t maxEntered);
+		void setWaitingSignal(Signal &waitingSignal);
+		void enter(size_t count = 1);
+		void add(size_t count);
+		void leave(size_t count = 1);
+		bool tryEnter(size_t count);
+		bool full();
+	};
+
 	// a "packet" type structure representing some data (not necessarily an entire file)
+	// the data is in a slab, a fixed size block of memory, which is kept to be used again once it's written instead of freed
+	// this way, once enough slabs have been allocated, no more are (until they're all released at the end)
 	struct Data {
-		typedef std::shared_ptr<unsigned char> POINTER;
-		typedef std::queue<Data> QUEUE;
-		typedef Lock<QUEUE> QUEUE_LOCK;
+		static const size_t SLAB_SIZE = 0x10000;
+
+		struct SlabDeleter {
+			void operator()(unsigned char* slab) const;
+		};
+
+		typedef std::unique_ptr<unsigned char[], SlabDeleter> POINTER;
+		typedef std::vector<Data> VECTOR;
 
 		size_t size = 0;
 		POINTER pointer = 0;
 
 		Data();
 		Data(size_t size, POINTER pointer);
+		static POINTER allocateSlab();
+		static void releaseSlabs();
+
+		private:
+		static std::mutex slabMutex;
+		static std::vector<unsigned char*> slabVector;
+	};
+
+	// Index (the directories of every BigFile in a file, so they needn't be parsed again)
+	// it is kept next to the file, and is only used if the file is the same size,
+	// was last written at the same time, and has the same hash as when the index was created
+	class Index {
+		public:
+		class Invalid : public std::invalid_argument {
+			public:
+			Invalid() noexcept : std::invalid_argument("Index invalid") {
+			}
+		};
+
+		// the BigFile record is where it is in the index, and
+		// directoryEndPosition is where its files begin in the input file
+		struct Entry {
+			std::streampos directoryEndPosition = 0;
+			size_t recordPosition = 0;
+			size_t recordSize = 0;
+		};
+
+		typedef std::map<std::streampos, Entry> ENTRY_MAP;
+
+		// identifies the input file, so that anything kept about it can be thrown out if it changes
+		struct Key {
+			uint64_t size = 0;
+			int64_t lastWriteTime = 0;
+			uint64_t hash = 0;
+
+			Key(std::istream &inputStream, const std::filesystem::path &path);
+			void write(std::ostream &outputStream) const;
+			bool read(Ubi::SpanReader &indexReader) const;
+
+			private:
+			static const size_t SAMPLES = 16;
+			static const size_t SAMPLE_SIZE = 0x1000;
+		};
+
+		private:
+		typedef uint32_t VERSION;
+		typedef uint32_t ENTRY_MAP_SIZE;
+		typedef uint64_t POSITION;
+		typedef std::set<std::streampos> POSITION_SET;
+
+		// reads every BigFile on as many threads as there are, each as soon as the BigFile that owns it has been read
+		// (the input file must be mapped for this, so they don't all have to share one stream)
+		class Plans {
+			public:
+			struct Plan {
+				typedef std::shared_ptr<Plan> POINTER;
+				typedef std::map<std::streampos, POINTER> POINTER_MAP;
+
+				// a copy of the file that owns the BigFile, for its layer information
+				// the BigFile that owns that file is kept until then, because the layer information is in it
+				Ubi::BigFile::POINTER ownerBigFilePointer = 0;
+				std::optional<Ubi::BigFile::File> fileOptional = std::nullopt;
+
+				std::string record = "";
+				std::streampos directoryEndPosition = -1;
+				std::exception_ptr exceptionPointer = 0;
+			};
+
+			Plans(const MappedFile &mappedFile, Ubi::BigFile::File &file, uint32_t maxThreads);
+			~Plans();
+			Plans(const Plans &plans) = delete;
+			Plans &operator=(const Plans &plans) = delete;
+			const Plan::POINTER_MAP &wait();
+
+			private:
+			static void readThread(Plans &plans);
+
+			void destroy();
+			void read(std::streampos bigFileInputPosition, Plan &plan, Plan::POINTER_MAP &planPointerMap) const;
+
+			const unsigned char* data = 0;
+			size_t size = 0;
+
+			// positionSet is the BigFiles waiting to be read, read from the lowest position to the highest
+			// reading is how many BigFiles are being read right now, so it's only done once both are empty
+			std::mutex mutex = {};
+			std::condition_variable conditionVariable = {};
+			Plan::POINTER_MAP planPointerMap = {};
+			POSITION_SET positionSet = {};
+			size_t reading = 0;
+			bool stop = false;
+
+			std::vector<std::thread> threadVector = {};
+		};
+
+		std::string index = "";
+		ENTRY_MAP entryMap = {};
+
+		void load(const Key &key);
+		void open(std::istream &inputStream, const std::filesystem::path &path, const MappedFile* mappedFilePointer, bool create, uint32_t maxThreads);
+		void create(const Key &key, ENTRY_MAP_SIZE entries, const std::string &entriesString);
+		void create(std::istream &inputStream, const Key &key);
+		void create(const MappedFile &mappedFile, const Key &key, uint32_t maxThreads);
+
+		static void create(
+			std::istream &inputStream,
+			Ubi::BigFile::File &file,
+			std::ostream &entriesStream,
+			ENTRY_MAP_SIZE &entries,
+			POSITION_SET &bigFileInputPositionSet
+		);
+
+		static void writeEntry(
+			std::ostream &entriesStream,
+			std::streampos bigFileInputPosition,
+			std::streampos directoryEndPosition,
+			const std::string &record
+		);
+
+		static const std::string SIGNATURE;
+		static const VERSION CURRENT_VERSION = 1;
+
+		public:
+		// if create is false and there is no valid index, Invalid is thrown instead of creating one
+		// if the input file is mapped, the index is created by reading the BigFiles on as many as maxThreads threads at once
+		Index(std::istream &inputStream, const std::filesystem::path &path, const MappedFile* mappedFilePointer = 0, bool create = true, uint32_t maxThreads = 1);
+		Index(const Index &index) = delete;
+		Index &operator=(const Index &index) = delete;
+		const Entry* find(std::streampos bigFileInputPosition) const;
+		Ubi::SpanReader getRecordReader(const Entry &entry) const;
+
+		// the returned file has no name, only a size and position, and the stream is left at the file
+		Ubi::BigFile::File findFile(std::istream &inputStream, const Ubi::BigFile::Path::VECTOR &pathVector) const;
+
+		static void remove(const std::filesystem::path &path);
+		static std::filesystem::path getPath(std::filesystem::path path);
 	};
 
 	// BigFileTask (must seek over them, then come back later)
+	// they form a tree, each one pointing to the BigFile that owns it (the top BigFile has no owner)
+	// so that a BigFile's filesystem can be written as soon as all of its files are, without looking anything up
 	class BigFileTask {
+		public:
+		typedef std::shared_ptr<BigFileTask> POINTER;
+
 		private:
 		// fileSystemSize MUST be defined before bigFile
 		// (otherwise the constructor will be all messed up)
 		// it can't be const because it's passed to BigFile's constructor by reference
 		// so it has a getter instead
 		// file is the associated file (so the size can be set on it later)
-		std::streampos ownerBigFileInputPosition = -1;
+		POINTER ownerBigFileTaskPointer = 0;
 		Ubi::BigFile::File &file;
 		Ubi::BigFile::File::SIZE fileSystemSize = 0;
 		Ubi::BigFile::File::POINTER_VECTOR::size_type files = 0;
 		Ubi::BigFile::POINTER bigFilePointer = 0;
 
 		public:
-		typedef std::shared_ptr<BigFileTask> POINTER;
-		typedef std::map<std::streampos, POINTER> POINTER_MAP;
-		typedef Lock<POINTER_MAP> POINTER_MAP_LOCK;
-
-		// outputPosition is set by the output thread, and later used by it so it knows where to jump back
+		// these are only used by the output thread
+		// outputPosition is where the BigFile begins in the output (or -1 if nothing has been written to it yet)
+		// and it's used later to know where to jump back to, to write the filesystem
+		// filePosition is where the next of its files goes, relative to outputPosition
+		// once filesWritten is all of its files, its filesystem is written
 		std::streampos outputPosition = -1;
+		Ubi::BigFile::File::SIZE filePosition = 0;
 		Ubi::BigFile::File::POINTER_VECTOR::size_type filesWritten = 0;
+		bool written = false;
 
 		BigFileTask(
 			std::istream &inputStream,
-			std::streampos ownerBigFileInputPosition,
-			Ubi::BigFile::File &file,
-			Ubi::BigFile::File::POINTER_SET_MAP &fileVectorIteratorSetMap
+			const POINTER &ownerBigFileTaskPointer,
+			Ubi::BigFile::File &file
 		);
 
-		std::streampos getOwnerBigFileInputPosition() const;
+		BigFileTask(
+			Ubi::SpanReader &spanReader,
+			const POINTER &ownerBigFileTaskPointer,
+			Ubi::BigFile::File &file
+		);
+
+		BigFileTask(
+			const Index &index,
+			const Index::Entry &entry,
+			const POINTER &ownerBigFileTaskPointer,
+			Ubi::BigFile::File &file
+		);
+
+		POINTER getOwnerBigFileTaskPointer() const;
 		Ubi::BigFile::File &getFile() const;
 		Ubi::BigFile::File::SIZE getFileSystemSize() const;
 		Ubi::BigFile::File::POINTER_VECTOR::size_type getFiles() const;
@@ -120,10 +397,14 @@ namespace Work {
 	};
 
 	// FileTask (must be written in order)
+	class Writer;
+	class Segment;
+
 	class FileTask {
 		public:
 		typedef std::shared_ptr<FileTask> POINTER;
-		typedef std::queue<POINTER> POINTER_QUEUE;
+		// a deque so that the output thread can look past the front of it
+		typedef std::deque<POINTER> POINTER_QUEUE;
 		typedef Lock<POINTER_QUEUE> POINTER_QUEUE_LOCK;
 		typedef std::variant<Ubi::BigFile::File::POINTER_VECTOR_POINTER, Ubi::BigFile::File*> FILE_VARIANT;
 
@@ -137,45 +418,226 @@ namespace Work {
 		// (because it can't know what its final size will be, and therefore the next position to go to)
 		// once at the end of the data queue, the output thread will check if completed is true
 		// if it's false, it'll wait on more data again, otherwise it'll move to the next FileTask
-		// the output thread will check if the next file in the queue has a lesser value for bigFileInputPosition
-		// and if so, the corresponding BigFile(s) in the task vector are considered completed and are written
-		std::streampos ownerBigFileInputPosition = -1;
+		// once all the files of the BigFile that owns it are written, its filesystem is written
+		// (and so on, for the BigFile that owns that one)
+		// the last FileTask has no owner, which signals to the output thread that everything has been queued
+		BigFileTask::POINTER ownerBigFileTaskPointer = 0;
 		FILE_VARIANT fileVariant = {};
-		Event event;
-		Data::QUEUE queue = {};
+
+		// the data queue is a ring, because only one thread (reading or converting the file) ever adds data to it
+		// and only the output thread ever takes data from it, so neither needs a lock
+		// a thread only sleeps if the ring is full and is only woken up if it's actually asleep
+		// so data is usually handed off without any system call
+		// the output thread doesn't sleep on any one ring, because it may take data from whichever has some
+		// so instead, adding data signals it (which also only wakes it up if it's asleep)
+		static const size_t RING_SIZE = 0x100;
+
+		Data ring[RING_SIZE] = {};
+
+		std::atomic<size_t> readIndex = 0;
+		std::atomic<size_t> writeIndex = 0;
+		std::atomic<bool> writing = false;
+
+		Signal &outputSignal;
+
+		// the last index each thread saw of the other, so it only has to look again when it catches up to it
+		size_t writeReadIndex = 0;
+		size_t readWriteIndex = 0;
+
+		// if the size of the file is known before its data is (because it only depends on the extents and format it's converted to)
+		// the output thread leaves space for it and moves on, then the data is written in that space as it's converted
+		std::atomic<std::streamsize> plannedSize = -1;
+		std::atomic<std::streamoff> placedPosition = -1;
+		Writer* placedWriterPointer = 0;
+
+		#ifdef LINUX
+		// on Linux, copied data isn't read at all, instead this is where it is in the input file
+		// so the output thread can have the kernel copy it straight to the output file
+		std::streampos passthroughInputPosition = -1;
+		std::streamsize passthroughCount = 0;
+
+		// if the file is a BigFile written into its own segment, there is no data, the segment is copied in instead
+		std::shared_ptr<Segment> segmentPointer = 0;
+		#endif
 
 		public:
-		FileTask(std::streampos ownerBigFileInputPosition, Ubi::BigFile::File* filePointer);
-		FileTask(std::streampos ownerBigFileInputPosition, Ubi::BigFile::File::POINTER_VECTOR_POINTER &filePointerVectorPointer);
-		Data::QUEUE_LOCK lock(bool &yield);
-		Data::QUEUE_LOCK lock();
-		void copy(std::istream &inputStream, std::streamsize count);
+		FileTask(const BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File* filePointer, Signal &outputSignal);
+		FileTask(const BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File::POINTER_VECTOR_POINTER &filePointerVectorPointer, Signal &outputSignal);
+
+		#ifdef LINUX
+		FileTask(const BigFileTask::POINTER &ownerBigFileTaskPointer, Ubi::BigFile::File* filePointer, const std::shared_ptr<Segment> &segmentPointer, Signal &outputSignal);
+		#endif
+
+		FileTask(const FileTask &fileTask) = delete;
+		FileTask &operator=(const FileTask &fileTask) = delete;
+		void emplace(size_t size, Data::POINTER pointer);
+		bool tryPop(Data &data);
+		void copy(std::istream &inputStream, std::streamsize count, Gate &memoryGate);
+		void plan(std::streamsize size);
+		std::streamsize getPlannedSize();
+		void place(Writer &writer, std::streampos position);
+		Writer* getPlacedWriterPointer(std::streampos &position);
+
+		#ifdef LINUX
+		std::streampos getPassthroughInputPosition() const;
+		std::streamsize getPassthroughCount() const;
+		std::shared_ptr<Segment> getSegmentPointer() const;
+		#endif
 		void complete();
-		std::streampos getOwnerBigFileInputPosition();
+		BigFileTask::POINTER getOwnerBigFileTaskPointer();
 		FILE_VARIANT getFileVariant();
 	};
 
-	// Tasks (to be performed by the output thread)
-	class Tasks {
-		private:
-		// the list of BigFileTasks must be a vector, because
-		// they can't be handled in FIFO order
-		// (otherwise, the first BigFile would block for the entire duration)
-		Event bigFileEvent;
-		BigFileTask::POINTER_MAP bigFileTaskPointerMap = {};
+	// the FileTasks written by one output thread, into one file
+	// usually there is only the one, but on Linux the BigFiles in the top BigFile may each be written into their own
+	// then copied into the top one after (which the filesystem may do by sharing the blocks, instead of copying them)
+	class Segment {
+		public:
+		typedef std::shared_ptr<Segment> POINTER;
 
+		private:
 		// the list of FileTasks must be a queue, because
 		// they must be written in order, start to finish
 		// regardless of the order the data becomes available in
 		Event fileEvent;
 		FileTask::POINTER_QUEUE fileTaskPointerQueue = {};
 
+		std::string fileName = "";
+		std::string spillFileName = "";
+
 		public:
-		Tasks();
-		BigFileTask::POINTER_MAP_LOCK bigFileLock(bool &yield);
-		BigFileTask::POINTER_MAP_LOCK bigFileLock();
+		Segment(const char* fileName, const char* spillFileName);
+		Segment(const Segment &segment) = delete;
+		Segment &operator=(const Segment &segment) = delete;
 		FileTask::POINTER_QUEUE_LOCK fileLock(bool &yield);
 		FileTask::POINTER_QUEUE_LOCK fileLock();
+		const char* getFileName() const;
+		const char* getSpillFileName() const;
+
+		// the output thread writing the segment, and whether it should keep waiting for more FileTasks
+		std::thread thread = {};
+		bool yield = true;
+	};
+
+	// Tasks (to be performed by the output thread)
+	class Tasks {
+		private:
+		// (BigFileTasks aren't listed here, because each FileTask points to the one that owns it)
+		Segment segment;
+
+		// FileTasks are let through this before they're queued, and leave it once they're written
+		// so that if too many are queued at once, adding more waits for the output thread to catch up
+		// (to prevent running out of memory)
+		Gate fileGate;
+
+		// the bytes of memory held by files waiting to be converted, being converted, or waiting to be written
+		// only the thread reading the files waits on it, the others only add to it, so they never wait on each other
+		Gate memoryGate;
+
+		// the bytes of memory held by results kept for duplicates, which are set aside from the memory budget
+		// results are only kept if there's room for them, so nothing ever waits on it
+		Gate resultGate;
+
+		// signalled whenever any FileTask has more data
+		Signal outputSignal;
+
+		// how many buffers of output may be being written at once
+		unsigned int queueDepth = 0;
+
+		public:
+		Tasks();
+		Segment &getSegment();
+		void setMaxFileTasks(FileTask::POINTER_QUEUE::size_type maxFileTasks);
+		void enterFile();
+		void leaveFile();
+		void setMemoryBudget(size_t memoryBudget);
+		Gate &getMemoryGate();
+		Gate &getResultGate();
+		Signal &getOutputSignal();
+		void setQueueDepth(unsigned int queueDepth);
+		unsigned int getQueueDepth() const;
+	};
+
+	// converted files are kept from one time fixing loading to the next, so converting the same file the same way again
+	// only has to read what it was converted to last time
+	// the key is what the file is converted from and how, and entries are named by its hash, with the key at the start
+	// an entry is written to a temporary file and only renamed once it's complete, so one that was cut off is never found
+	// the entries for any other version of the cache or NVTT are removed, because they would never be found
+	class Cache {
+		public:
+		typedef uint64_t HASH;
+
+		class Entry {
+			private:
+			std::filesystem::path path = {};
+			std::filesystem::path temporaryPath = {};
+			std::ofstream fileStream = {};
+
+			public:
+			Entry(Cache &cache, const std::string &key);
+			~Entry();
+			Entry(const Entry &entry) = delete;
+			Entry &operator=(const Entry &entry) = delete;
+			void write(const void* pointer, size_t size);
+			void commit();
+		};
+
+		private:
+		typedef uint32_t VERSION;
+		typedef uint32_t KEY_SIZE;
+
+		std::filesystem::path path = {};
+
+		// so each entry being written has its own temporary file, even if the same file is being converted twice at once
+		std::atomic<uint32_t> temporaryFiles = 0;
+
+		std::string getHeader(const std::string &key) const;
+		std::filesystem::path getEntryPath(const std::string &key) const;
+
+		static const std::string SIGNATURE;
+		static const VERSION CURRENT_VERSION = 1;
+
+		public:
+		Cache(const std::filesystem::path &path);
+		Cache(const Cache &cache) = delete;
+		Cache &operator=(const Cache &cache) = delete;
+		bool find(const std::string &key, std::string &data) const;
+
+		static HASH hash(const unsigned char* data, size_t size);
+		static void remove(const std::filesystem::path &path);
+		static std::filesystem::path getPath(std::filesystem::path path);
+	};
+
+	// files with exactly the same data are converted the same way, so only the first of them is converted
+	// any others found while it's being converted wait for it, and what it was converted to is written out for them too
+	// after that, it's kept for any found later, if there's room for it
+	class Result {
+		public:
+		typedef std::shared_ptr<Result> POINTER;
+		typedef std::map<std::string, POINTER> POINTER_MAP;
+		typedef std::shared_ptr<const std::string> DATA_POINTER;
+
+		struct Duplicate {
+			typedef std::vector<Duplicate> VECTOR;
+
+			FileTask::POINTER fileTaskPointer = 0;
+			Ubi::BigFile::File* filePointer = 0;
+		};
+
+		private:
+		std::mutex mutex = {};
+		Gate &resultGate;
+		bool completed = false;
+		DATA_POINTER dataPointer = 0;
+		Duplicate::VECTOR duplicateVector = {};
+
+		public:
+		Result(Gate &resultGate);
+		~Result();
+		Result(const Result &result) = delete;
+		Result &operator=(const Result &result) = delete;
+		bool wait(const Duplicate &duplicate, DATA_POINTER &dataPointer);
+		Duplicate::VECTOR complete(const DATA_POINTER &dataPointer);
 	};
 
 	struct Convert {
@@ -199,23 +661,161 @@ namespace Work {
 		Ubi::BigFile::File &file;
 
 		FileTask::POINTER fileTaskPointer = 0;
-		Data::POINTER dataPointer = 0;
+		std::unique_ptr<unsigned char[]> dataPointer = 0;
+
+		// what the file is converted from and how, which is the same for duplicates and the same as in the cache
+		std::string key = "";
+		Cache* cachePointer = 0;
+		Result::POINTER resultPointer = 0;
+
+		// the file data is counted against the memory budget until it's freed
+		Gate &memoryGate;
+		size_t dataSize = 0;
 
 		Convert(
 			const Configuration &configuration,
 			const nvtt::Context &context,
-			Ubi::BigFile::File &file
+			Ubi::BigFile::File &file,
+			Gate &memoryGate
 		);
+
+		~Convert();
+		Convert(const Convert &convert) = delete;
+		Convert &operator=(const Convert &convert) = delete;
+		void readData(std::istream &inputStream);
+		void freeData();
+	};
+
+	#ifdef IO_URING
+	// just enough of io_uring to write registered buffers, without depending on liburing
+	class Ring {
+		private:
+		void destroy();
+
+		int fileDescriptor = -1;
+
+		void* submissionPointer = MAP_FAILED;
+		size_t submissionSize = 0;
+		void* completionPointer = MAP_FAILED;
+		size_t completionSize = 0;
+		io_uring_sqe* entriesPointer = (io_uring_sqe*)MAP_FAILED;
+		size_t entriesSize = 0;
+
+		// these are shared with the kernel
+		unsigned* submissionHeadPointer = 0;
+		unsigned* submissionTailPointer = 0;
+		unsigned* submissionArrayPointer = 0;
+		unsigned submissionRingMask = 0;
+
+		unsigned* completionHeadPointer = 0;
+		unsigned* completionTailPointer = 0;
+		io_uring_cqe* completionsPointer = 0;
+		unsigned completionRingMask = 0;
+
+		void enter(unsigned submit, unsigned complete, unsigned flags);
+
+		public:
+		Ring(unsigned int entries);
+		~Ring();
+		Ring(const Ring &ring) = delete;
+		Ring &operator=(const Ring &ring) = delete;
+		void registerBuffers(const iovec* iovecs, unsigned int count);
+		void write(int outputFileDescriptor, unsigned int bufferIndex, const void* pointer, size_t size, std::streampos position);
+		unsigned int wait(int32_t &result);
+	};
+	#endif
+
+	// writes a file at explicit positions, instead of through a stream that must seek (and flush) to get to them
+	// sequential writes are combined in a large buffer, and writes behind it (like filesystems that are filled in
+	// after their files) go around the buffer, or into it if it hasn't been written yet
+	// anything still in the buffer when this is destroyed is lost, so flush must be called when done
+	class Writer {
+		private:
+		void destroy();
+
+		#ifdef MACINTOSH
+		int fileDescriptor = -1;
+		#endif
+		#ifdef WINDOWS
+		HANDLE file = INVALID_HANDLE_VALUE;
+		#endif
+
+		// all of the buffers, only one of which is filled at a time, while the others may still be being written
+		std::unique_ptr<unsigned char[]> buffersPointer = 0;
+		unsigned int buffers = 1;
+		unsigned int bufferIndex = 0;
+
+		unsigned char* bufferPointer = 0;
+		size_t bufferSize = 0;
+
+		// where in the file the buffer is to be written
+		std::streampos bufferPosition = 0;
+
+		void writeFile(std::streampos position, const unsigned char* pointer, size_t size);
+		#ifdef MACINTOSH
+		void writeFile(std::streampos position, const Data::VECTOR &dataVector);
+		#endif
+		void submit();
+
+		#ifdef IO_URING
+		struct Slot {
+			std::streampos position = 0;
+			size_t size = 0;
+			bool writing = false;
+		};
+
+		typedef std::vector<Slot> SLOT_VECTOR;
+
+		SLOT_VECTOR slotVector = {};
+		unsigned int writingSlots = 0;
+
+		// (declared after the buffers, so it's destroyed before them)
+		std::optional<Ring> ringOptional = std::nullopt;
+
+		void complete();
+		void wait();
+		#endif
+
+		#ifdef LINUX
+		int inputFileDescriptor = -1;
+
+		void copy(int sourceFileDescriptor, off_t inputOffset, size_t count);
+		bool copyFileRange(int sourceFileDescriptor, off_t &inputOffset, off_t &outputOffset, size_t &count);
+		bool sendFile(int sourceFileDescriptor, off_t &inputOffset, off_t &outputOffset, size_t &count);
+		void copyRead(int sourceFileDescriptor, off_t &inputOffset, off_t &outputOffset, size_t &count);
+		#endif
+
+		public:
+		static const size_t BUFFER_SIZE = 0x400000;
+
+		Writer(const char* fileName, std::streampos position, unsigned int queueDepth = 0);
+		~Writer();
+		Writer(const Writer &writer) = delete;
+		Writer &operator=(const Writer &writer) = delete;
+		void write(const void* pointer, size_t size);
+		void write(std::streampos position, const void* pointer, size_t size);
+		void write(const Data::VECTOR &dataVector);
+		void fill(std::streamsize count);
+		void skip(std::streamsize count);
+		void place(std::streampos position, const void* pointer, size_t size);
+		void flush();
+		std::streampos tell() const;
+
+		#ifdef LINUX
+		void openPassthrough(const std::filesystem::path &inputPath);
+		void passthrough(std::streampos inputPosition, std::streamsize count);
+		std::streamsize stitch(const char* fileName);
+		#endif
 	};
 
 	struct Output {
 		std::ofstream fileStream = {};
 
-		std::streampos currentBigFileInputPosition = -1;
-		BigFileTask::POINTER bigFileTaskPointer = 0;
+		// only for output that may be carried on with later
+		std::optional<Writer> writerOptional = std::nullopt;
 
-		Ubi::BigFile::File::SIZE filePosition = 0;
-		Ubi::BigFile::File::POINTER_VECTOR::size_type filesWritten = 0;
+		// the BigFile that owns the last file written
+		BigFileTask::POINTER bigFileTaskPointer = 0;
 
 		struct Info {
 			std::filesystem::path path = {};
@@ -246,11 +846,156 @@ namespace Work {
 		static bool setPath(const std::filesystem::path &path);
 
 		Output(bool binary = true);
+
+		// for output that may be carried on with later, if outputPosition isn't zero
+		// the file is kept up to there, and the rest of it is written after it
+		// this is written with the writer instead of the file stream
+		Output(const char* fileName, std::streampos outputPosition, unsigned int queueDepth = 0);
+
 		~Output();
+		Output(const Output &output) = delete;
+		Output &operator=(const Output &output) = delete;
+
+		private:
+		const char* fileName = FILE_NAME;
+	};
+
+	// the output thread must write FileTasks in order, but instead of waiting on the first one while it's converted
+	// it takes the data of the ones after it as it becomes available, and keeps it until they're written
+	// so that they can carry on instead of waiting with full rings (this is the reorder window)
+	// the data stays in memory as long as there's room in the memory budget, after which it's spilled to a file
+	class Reorder {
+		private:
+		struct Chunk {
+			Data data = {};
+
+			// where the data is in the spill file, if it's not in memory
+			std::streampos spillPosition = -1;
+		};
+
+		typedef std::deque<Chunk> CHUNK_DEQUE;
+
+		struct Taken {
+			CHUNK_DEQUE chunkDeque = {};
+			bool completed = false;
+
+			// where the rest of the data goes, if the FileTask was placed
+			std::streampos placedPosition = -1;
+		};
+
+		typedef std::map<FileTask*, Taken> TAKEN_MAP;
+
+		Gate &memoryGate;
+		TAKEN_MAP takenMap = {};
+
+		const char* spillFileName = 0;
+		std::fstream spillFileStream = {};
+		std::streampos spillPosition = 0;
+		size_t spilledChunks = 0;
+
+		// FileTasks that were placed, but haven't been completed yet
+		FileTask::POINTER_QUEUE placedQueue = {};
+
+		void spill(Chunk &chunk);
+		void write(Taken &taken, Writer &writer);
+
+		public:
+		static const char* SPILL_FILE_NAME;
+
+		Reorder(Gate &memoryGate, const char* spillFileName);
+		~Reorder();
+		Reorder(const Reorder &reorder) = delete;
+		Reorder &operator=(const Reorder &reorder) = delete;
+		bool take(FileTask &fileTask);
+		bool spill();
+		bool write(FileTask &fileTask, Writer &writer);
+		bool place(const FileTask::POINTER &fileTaskPointer, Writer &writer);
+		bool takePlaced(Writer &writer);
+		bool getPlaced() const;
+	};
+
+	// records how far fixing loading has gotten, so if it's interrupted, the next time it can carry on from there
+	// only the files of the top BigFile are recorded, because when the output thread is back in the top BigFile
+	// everything before it (including the BigFiles in it) has been written completely
+	class Journal {
+		public:
+		class Invalid : public std::invalid_argument {
+			public:
+			Invalid() noexcept : std::invalid_argument("Journal invalid") {
+			}
+		};
+
+		// the files of the top BigFile that are done, in the order of its positionVector, with their new sizes and positions
+		// inputCopyPosition and inputFilePosition are what fixLoading had for them, when it moved on to the next file
+		struct Checkpoint {
+			struct File {
+				typedef std::vector<File> VECTOR;
+
+				Ubi::BigFile::File::SIZE size = 0;
+				Ubi::BigFile::File::SIZE position = 0;
+			};
+
+			File::VECTOR fileVector = {};
+			std::streampos outputPosition = 0;
+			Ubi::BigFile::File::SIZE filePosition = 0;
+			Ubi::BigFile::File::SIZE inputCopyPosition = 0;
+			Ubi::BigFile::File::SIZE inputFilePosition = 0;
+		};
+
+		private:
+		typedef uint32_t VERSION;
+		typedef uint32_t FILES;
+		typedef uint64_t POSITION;
+		typedef Cache::HASH HASH;
+
+		std::string header = "";
+		std::ofstream fileStream = {};
+		std::optional<Checkpoint> checkpointOptional = std::nullopt;
+
+		// how many files of the top BigFile are in the journal so far
+		FILES files = 0;
+
+		// set by the reading thread once a file is cut short, so nothing after it is written to the journal
+		std::atomic<bool> stopped = false;
+
+		void open(std::istream &inputStream, const std::filesystem::path &path);
+		void create();
+		size_t load(const std::string &journal);
+
+		static const std::string SIGNATURE;
+		static const VERSION CURRENT_VERSION = 1;
+
+		public:
+		static const char* FILE_NAME;
+		static const char* OUTPUT_FILE_NAME;
+
+		Journal(std::istream &inputStream, const std::filesystem::path &path);
+		Journal(const Journal &journal) = delete;
+		Journal &operator=(const Journal &journal) = delete;
+		const std::optional<Checkpoint> &getCheckpointOptional() const;
+
+		// if the checkpoint doesn't fit the BigFile, it's thrown out and false is returned
+		bool restore(
+			Ubi::BigFile &bigFile,
+			Ubi::BigFile::Position::VECTOR::size_type &files,
+			Ubi::BigFile::File::SIZE &inputCopyPosition,
+			Ubi::BigFile::File::SIZE &inputFilePosition
+		);
+
+		void write(
+			const Ubi::BigFile &bigFile,
+			Ubi::BigFile::File::POINTER_VECTOR::size_type files,
+			std::streampos outputPosition,
+			Ubi::BigFile::File::SIZE filePosition,
+			bool copied
+		);
+
+		void stop();
+		static void remove();
 	};
 
 	namespace Backup {
-		void create(const char* fileName);
+		void create(const char* fileName, const char* outputFileName = Output::FILE_NAME);
 		void createOutput(const char* fileName);
 		void createEmpty(const std::filesystem::path &path);
 		void restore(const std::filesystem::path &path);
@@ -272,6 +1017,7 @@ namespace Work {
 
 		Edit(std::fstream &fileStream, const std::filesystem::path &path);
 		void apply(std::thread &copyThread, const CODE_VECTOR &codeVector);
+		const std::filesystem::path &getPath() const;
 
 		private:
 		std::filesystem::path path = {};
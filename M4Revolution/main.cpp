@@ -47,6 +47,48 @@ std::string getAppInstallDir() {
 	return std::filesystem::current_path().string();
 }
 
+// a number of bytes, optionally followed by K, M or G for kilobytes, megabytes or gigabytes (such as 512M)
+bool stringToBytes(const char* str, size_t &result) {
+	unsigned long number = 0;
+	size_t size = stringToLongUnsigned(str, number, 10);
+
+	if (!size) {
+		return false;
+	}
+
+	size_t shift = 0;
+
+	switch (str[size]) {
+		case '\0':
+		break;
+		case 'K':
+		case 'k':
+		shift = 10;
+		size++;
+		break;
+		case 'M':
+		case 'm':
+		shift = 20;
+		size++;
+		break;
+		case 'G':
+		case 'g':
+		shift = 30;
+		size++;
+		break;
+		default:
+		return false;
+	}
+
+	// check there's nothing after the suffix, and that it doesn't overflow
+	if (str[size] || (size_t)number > (SIZE_MAX >> shift)) {
+		return false;
+	}
+
+	result = (size_t)number << shift;
+	return true;
+}
+
 std::optional<bool> performOperation(M4Revolution &m4Revolution) {
 	const long OPERATION_OPEN_ONLINE_HELP = 1;
 	const long OPERATION_TOGGLE_FULL_SCREEN = 2;
@@ -110,8 +152,12 @@ int main(int argc, char** argv) {
 	std::optional<std::string> pathStringOptional = std::nullopt;
 	bool logFileNames = false;
 	bool disableHardwareAcceleration = false;
+	bool cacheConvertedFiles = false;
 	unsigned long maxThreads = 0;
 	unsigned long maxFileTasks = 0;
+	size_t memoryBudget = 0;
+	unsigned long queueDepth = 0;
+	bool segmentedOutput = false;
 	std::optional<Work::Convert::Configuration> configurationOptional = std::nullopt;
 
 	for (int i = MIN_ARGC; i < argc; i++) {
@@ -124,6 +170,11 @@ int main(int argc, char** argv) {
 			logFileNames = true;
 		} else if (arg == "-nohw" || arg == "--disable-hardware-acceleration") {
 			disableHardwareAcceleration = true;
+		} else if (arg == "-cc" || arg == "--cache-converted-files") {
+			cacheConvertedFiles = true;
+		} else if (arg == "--dev-segmented-output") {
+			// this disables the journal, so if Fixing Loading is interrupted it will start over from the beginning
+			segmentedOutput = true;
 		} else if (i < argc2) {
 			if (arg == "-p" || arg == "--path") {
 				pathStringOptional = argv[++i];
@@ -133,12 +184,24 @@ int main(int argc, char** argv) {
 					help();
 					return 1;
 				}
+			} else if (arg == "-mb" || arg == "--memory-budget") {
+				if (!stringToBytes(argv[++i], memoryBudget)) {
+					consoleLog("Memory Budget must be a valid size, such as 512M", 2);
+					help();
+					return 1;
+				}
 			} else if (arg == "--dev-max-file-tasks") {
 				if (!stringToLongUnsigned(argv[++i], maxFileTasks)) {
 					consoleLog("Max File Tasks must be a valid number", 2);
 					help();
 					return 1;
 				}
+			} else if (arg == "--dev-queue-depth") {
+				if (!stringToLongUnsigned(argv[++i], queueDepth)) {
+					consoleLog("Queue Depth must be a valid number", 2);
+					help();
+					return 1;
+				}
 			} else if (i < argc7) {
 				if (arg == "--dev-configuration") {
 					Work::Convert::Configuration &configuration = configurationOptional.emplace();
@@ -162,7 +225,7 @@ int main(int argc, char** argv) {
 		pathStringOptional.emplace(getAppInstallDir());
 	}
 
-	M4Revolution m4Revolution(pathStringOptional.value(), logFileNames, disableHardwareAcceleration, maxThreads, maxFileTasks, configurationOptional);
+	M4Revolution m4Revolution(pathStringOptional.value(), logFileNames, disableHardwareAcceleration, cacheConvertedFiles, maxThreads, maxFileTasks, memoryBudget, queueDepth, segmentedOutput, configurationOptional);
 	std::optional<bool> performedOperationOptional = std::nullopt;
 
 	for(;;) {
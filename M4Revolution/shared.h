@@ -23,6 +23,11 @@
 #endif
 #ifndef WINDOWS
 	#define MACINTOSH
+
+	// Linux is otherwise treated the same, except where it has system calls of its own
+	#ifdef __linux__
+		#define LINUX
+	#endif
 #endif
 
 #ifdef WINDOWS